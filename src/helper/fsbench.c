@@ -0,0 +1,225 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "driver/block.h"
+#include "driver/disk.h"
+#include "filesystem/cache.h"
+#include "filesystem/fat32.h"
+#include "filesystem/vfs.h"
+#include "ramdisk.h"
+
+/*
+ * Host build of kernel FAT32 driver over a RAM disk (ramdisk.c). Every benchmark
+ * goes through the VFS table, disk access is counted at read_blocks/write_blocks.
+ * Usage: ./fsbench [disk size in MiB]
+ *
+ * Kernel string.h and shared time.h shadow libc here, so only stdio/stdlib and
+ * sys/time.h are used
+ */
+
+/* Benchmark */
+#define MAX_FILE_SIZE (8 * 1024 * 1024)
+#define IO_CHUNK_SIZE 4096
+#define RANDOM_IO_SIZE 512
+#define RANDOM_IO_COUNT 4096
+
+static uint8_t *pattern;
+static uint8_t *readback;
+static char path[64];
+static int failure_count = 0;
+
+struct Measurement {
+	const char *name;
+	struct timeval start;
+	struct RamDiskCounter counter;
+};
+
+static char *make_path(const char *format, int a, int b) {
+	snprintf(path, sizeof(path), format, a, b);
+	return path;
+}
+
+static void check(bool condition, const char *what) {
+	if (!condition) {
+		printf("FAIL %s\n", what);
+		failure_count += 1;
+	}
+}
+
+static void begin(struct Measurement *measurement, const char *name) {
+	measurement->name = name;
+	measurement->counter = ramdisk_counter;
+	gettimeofday(&measurement->start, NULL);
+}
+
+/**
+ * Print one result row
+ *
+ * @param op_count Operation count of measured loop
+ * @param bytes    Payload bytes moved, 0 for metadata operation
+ */
+static void end(struct Measurement *measurement, uint32_t op_count, uint64_t bytes) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	double second = (now.tv_sec - measurement->start.tv_sec) + (now.tv_usec - measurement->start.tv_usec) / 1e6;
+	if (second <= 0) second = 1e-9;
+
+	printf(
+			"%-28s %8u %12.0f %10.1f %10llu %10llu %8llu %8llu\n",
+			measurement->name, op_count, op_count / second, bytes / second / (1024 * 1024),
+			(unsigned long long)(ramdisk_counter.read_block - measurement->counter.read_block),
+			(unsigned long long)(ramdisk_counter.write_block - measurement->counter.write_block),
+			(unsigned long long)(ramdisk_counter.read_command - measurement->counter.read_command),
+			(unsigned long long)(ramdisk_counter.write_command - measurement->counter.write_command)
+	);
+}
+
+static void bench_file_size(uint32_t size) {
+	char name[48];
+	struct Measurement measurement;
+
+	snprintf(name, sizeof(name), "seq write %uK", size / 1024);
+	begin(&measurement, name);
+	check(vfs.mkfile(make_path("/bench/s%d", size / 1024, 0)) == 0, "mkfile for sequential write");
+	int ft = vfs.open(make_path("/bench/s%d", size / 1024, 0));
+	uint32_t op_count = 0;
+	for (uint32_t offset = 0; offset < size; offset += IO_CHUNK_SIZE, op_count++)
+		check(vfs.write(ft, (char *)pattern + offset, IO_CHUNK_SIZE) == IO_CHUNK_SIZE, "sequential write");
+	vfs.close(ft);
+	end(&measurement, op_count, size);
+
+	snprintf(name, sizeof(name), "seq read %uK", size / 1024);
+	begin(&measurement, name);
+	ft = vfs.open(make_path("/bench/s%d", size / 1024, 0));
+	op_count = 0;
+	for (uint32_t offset = 0; offset < size; offset += IO_CHUNK_SIZE, op_count++)
+		check(vfs.read(ft, (char *)readback + offset, IO_CHUNK_SIZE) == IO_CHUNK_SIZE, "sequential read");
+	vfs.close(ft);
+	end(&measurement, op_count, size);
+
+	for (uint32_t i = 0; i < size; i++) {
+		if (readback[i] != pattern[i]) {
+			check(false, "sequential read content");
+			break;
+		}
+	}
+}
+
+static void bench_random(uint32_t size) {
+	struct Measurement measurement;
+	int ft = vfs.open(make_path("/bench/s%d", size / 1024, 0));
+	uint32_t seed = 2024;
+
+	begin(&measurement, "random pread 512");
+	for (int i = 0; i < RANDOM_IO_COUNT; i++) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t offset = (seed >> 4) % (size - RANDOM_IO_SIZE);
+		check(vfs.pread(ft, (char *)readback, RANDOM_IO_SIZE, offset) == RANDOM_IO_SIZE, "random read");
+	}
+	end(&measurement, RANDOM_IO_COUNT, (uint64_t)RANDOM_IO_COUNT * RANDOM_IO_SIZE);
+
+	begin(&measurement, "random pwrite 512");
+	for (int i = 0; i < RANDOM_IO_COUNT; i++) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t offset = (seed >> 4) % (size - RANDOM_IO_SIZE);
+		check(vfs.pwrite(ft, (char *)pattern + offset, RANDOM_IO_SIZE, offset) == RANDOM_IO_SIZE, "random write");
+	}
+	vfs.close(ft);
+	end(&measurement, RANDOM_IO_COUNT, (uint64_t)RANDOM_IO_COUNT * RANDOM_IO_SIZE);
+}
+
+// Fill directory up to fill entries, then measure operations at that level
+static void bench_directory(int fill) {
+	char name[48];
+	struct Measurement measurement;
+	struct VFSEntry entry;
+	int batch = 32;
+
+	check(vfs.mkdir(make_path("/d%d", fill, 0)) == 0, "mkdir directory level");
+	for (int i = 0; i < fill; i++)
+		check(vfs.mkfile(make_path("/d%d/f%d", fill, i)) == 0, "directory fill");
+
+	snprintf(name, sizeof(name), "mkfile @%d", fill);
+	begin(&measurement, name);
+	for (int i = 0; i < batch; i++)
+		check(vfs.mkfile(make_path("/d%d/n%d", fill, i)) == 0, "mkfile");
+	end(&measurement, batch, 0);
+
+	snprintf(name, sizeof(name), "mkdir @%d", fill);
+	begin(&measurement, name);
+	for (int i = 0; i < batch; i++)
+		check(vfs.mkdir(make_path("/d%d/m%d", fill, i)) == 0, "mkdir");
+	end(&measurement, batch, 0);
+
+	if (fill > 0) {
+		snprintf(name, sizeof(name), "open+close @%d", fill);
+		begin(&measurement, name);
+		for (int i = 0; i < fill; i++) {
+			int ft = vfs.open(make_path("/d%d/f%d", fill, i));
+			check(ft >= 0, "open");
+			vfs.close(ft);
+		}
+		end(&measurement, fill, 0);
+	}
+
+	snprintf(name, sizeof(name), "stat miss @%d", fill);
+	begin(&measurement, name);
+	for (int i = 0; i < batch; i++)
+		check(vfs.stat(make_path("/d%d/x%d", fill, i), &entry) != 0, "stat miss");
+	end(&measurement, batch, 0);
+
+	snprintf(name, sizeof(name), "delete @%d", fill);
+	begin(&measurement, name);
+	for (int i = 0; i < batch; i++) {
+		check(vfs.delete(make_path("/d%d/n%d", fill, i)) == 0, "delete file");
+		check(vfs.delete(make_path("/d%d/m%d", fill, i)) == 0, "delete directory");
+	}
+	end(&measurement, 2 * batch, 0);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t disk_mib = 64;
+	if (argc >= 2)
+		disk_mib = atoi(argv[1]);
+
+	ramdisk_block_count = disk_mib * 1024 * 1024 / BLOCK_SIZE;
+	ramdisk_image = calloc(ramdisk_block_count, BLOCK_SIZE);
+	pattern = malloc(MAX_FILE_SIZE);
+	readback = malloc(MAX_FILE_SIZE);
+	for (uint32_t i = 0; i < MAX_FILE_SIZE; i++)
+		pattern[i] = (uint8_t)(i * 31 + i / 4099);
+
+	initialize_filesystem_fat32();
+	mount("/", &fat32_vfs);
+	vfs.mkdir(make_path("/bench", 0, 0));
+
+	printf("disk %u MiB, %u clusters\n", disk_mib, fat32_driver_state.cluster_count);
+	printf(
+			"%-28s %8s %12s %10s %10s %10s %8s %8s\n",
+			"benchmark", "ops", "ops/sec", "MiB/s", "blk read", "blk write", "rd cmd", "wr cmd"
+	);
+
+	uint32_t file_sizes[] = {4 * 1024, 64 * 1024, 1024 * 1024, MAX_FILE_SIZE};
+	for (uint32_t i = 0; i < sizeof(file_sizes) / sizeof(file_sizes[0]); i++) {
+		if (file_sizes[i] / CLUSTER_SIZE * 2 > fat32_driver_state.cluster_count) break;
+		bench_file_size(file_sizes[i]);
+	}
+	bench_random(1024 * 1024);
+
+	int fill_levels[] = {0, 60, 500};
+	for (uint32_t i = 0; i < sizeof(fill_levels) / sizeof(fill_levels[0]); i++)
+		bench_directory(fill_levels[i]);
+
+	printf(
+			"cache hit %u miss %u eviction %u writeback %u, block queue merged %u of %u\n",
+			cache_statistic.hit, cache_statistic.miss, cache_statistic.eviction, cache_statistic.writeback,
+			block_statistic.merged, block_statistic.submitted
+	);
+	if (failure_count > 0) {
+		printf("%d check failed\n", failure_count);
+		return 1;
+	}
+	return 0;
+}
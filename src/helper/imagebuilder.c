@@ -0,0 +1,252 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "filesystem/cache.h"
+#include "filesystem/fat32.h"
+#include "filesystem/vfs.h"
+#include "ramdisk.h"
+
+/*
+ * Populate storage image in one pass with kernel FAT32 driver (ramdisk.c)
+ * working directly on mmap of the image. Usage:
+ *   ./imagebuilder <storage> <source>...
+ * Each source is one of
+ *   <host directory>         whole tree copied into image root
+ *   @<manifest>              lines of "<host file> <image path>", # comment
+ *   <host file>:<image path> single file
+ * Missing parent directories are created, existing files are replaced
+ *
+ * Kernel string.c replace libc string functions here, so none of them is used
+ */
+
+#define IMAGE_PATH_SIZE 256
+#define MAX_TREE_ENTRY 256
+
+static int failure_count = 0;
+
+static void fail(const char *what, const char *path) {
+	fprintf(stderr, "imagebuilder: %s: %s\n", what, path);
+	failure_count += 1;
+}
+
+// VFS may tokenize path in place, hand it a copy
+static char *vfs_path(const char *path) {
+	static char copy[IMAGE_PATH_SIZE];
+	snprintf(copy, sizeof(copy), "%s", path);
+	return copy;
+}
+
+static bool is_directory(const char *image_path) {
+	struct VFSEntry entry;
+	return vfs.stat(vfs_path(image_path), &entry) == 0 && entry.type == Directory;
+}
+
+// mkdir -p for every directory above image_path
+static bool make_parent_directories(const char *image_path) {
+	char prefix[IMAGE_PATH_SIZE];
+	for (int i = 1; image_path[i] != '\0'; i++) {
+		if (image_path[i] != '/') continue;
+		snprintf(prefix, sizeof(prefix), "%.*s", i, image_path);
+		if (is_directory(prefix)) continue;
+		if (vfs.mkdir(vfs_path(prefix)) != 0) {
+			fail("can not create directory", prefix);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void make_directory(const char *image_path) {
+	if (is_directory(image_path)) return;
+	if (!make_parent_directories(image_path)) return;
+	if (vfs.mkdir(vfs_path(image_path)) != 0)
+		fail("can not create directory", image_path);
+}
+
+static void insert_file(const char *host_path, const char *image_path) {
+	FILE *file = fopen(host_path, "rb");
+	if (file == NULL) {
+		fail("can not open", host_path);
+		return;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char *content = malloc(size > 0 ? size : 1);
+	size_t read_size = fread(content, 1, size, file);
+	fclose(file);
+	if ((long)read_size != size) {
+		fail("short read", host_path);
+		free(content);
+		return;
+	}
+
+	struct VFSEntry entry;
+	if (vfs.stat(vfs_path(image_path), &entry) == 0) {
+		if (entry.type == Directory || vfs.delete(vfs_path(image_path)) != 0) {
+			fail("can not replace", image_path);
+			free(content);
+			return;
+		}
+	}
+
+	if (!make_parent_directories(image_path) || vfs.mkfile(vfs_path(image_path)) != 0) {
+		fail("can not create file", image_path);
+		free(content);
+		return;
+	}
+
+	int ft = vfs.open(vfs_path(image_path));
+	if (ft < 0 || vfs.write(ft, content, size) != size)
+		fail("can not write", image_path);
+	if (ft >= 0)
+		vfs.close(ft);
+	free(content);
+	printf("%s -> %s (%ld bytes)\n", host_path, image_path, size);
+}
+
+static int compare_name(const void *a, const void *b) {
+	const unsigned char *left = *(unsigned char *const *)a;
+	const unsigned char *right = *(unsigned char *const *)b;
+	while (*left != '\0' && *left == *right) {
+		left++;
+		right++;
+	}
+	return *left - *right;
+}
+
+// Entries sorted by name so the same tree always give the same layout
+static void insert_tree(const char *host_directory, const char *image_directory) {
+	DIR *directory = opendir(host_directory);
+	if (directory == NULL) {
+		fail("can not open directory", host_directory);
+		return;
+	}
+
+	char *names[MAX_TREE_ENTRY];
+	int name_count = 0;
+	struct dirent *dirent;
+	while ((dirent = readdir(directory)) != NULL) {
+		if (dirent->d_name[0] == '.') continue;
+		if (name_count == MAX_TREE_ENTRY) {
+			fail("too many entries", host_directory);
+			break;
+		}
+		char *name = malloc(IMAGE_PATH_SIZE);
+		snprintf(name, IMAGE_PATH_SIZE, "%s", dirent->d_name);
+		names[name_count++] = name;
+	}
+	closedir(directory);
+	qsort(names, name_count, sizeof(char *), compare_name);
+
+	for (int i = 0; i < name_count; i++) {
+		char host_path[IMAGE_PATH_SIZE * 2];
+		char image_path[IMAGE_PATH_SIZE];
+		snprintf(host_path, sizeof(host_path), "%s/%s", host_directory, names[i]);
+		snprintf(image_path, sizeof(image_path), "%s/%s", image_directory, names[i]);
+
+		struct stat host_stat;
+		if (stat(host_path, &host_stat) != 0) {
+			fail("can not stat", host_path);
+		} else if (S_ISDIR(host_stat.st_mode)) {
+			make_directory(image_path);
+			insert_tree(host_path, image_path);
+		} else if (S_ISREG(host_stat.st_mode)) {
+			insert_file(host_path, image_path);
+		}
+		free(names[i]);
+	}
+}
+
+static void insert_manifest(const char *manifest_path) {
+	FILE *manifest = fopen(manifest_path, "r");
+	if (manifest == NULL) {
+		fail("can not open manifest", manifest_path);
+		return;
+	}
+
+	char line[IMAGE_PATH_SIZE * 2];
+	while (fgets(line, sizeof(line), manifest) != NULL) {
+		char host_path[IMAGE_PATH_SIZE];
+		char image_path[IMAGE_PATH_SIZE];
+		if (sscanf(line, " %255s %255s", host_path, image_path) != 2 || host_path[0] == '#')
+			continue;
+		if (image_path[0] != '/') {
+			fail("image path must be absolute", image_path);
+			continue;
+		}
+		insert_file(host_path, image_path);
+	}
+	fclose(manifest);
+}
+
+static void insert_source(const char *source) {
+	if (source[0] == '@') {
+		insert_manifest(source + 1);
+		return;
+	}
+
+	struct stat host_stat;
+	if (stat(source, &host_stat) == 0 && S_ISDIR(host_stat.st_mode)) {
+		insert_tree(source, "");
+		return;
+	}
+
+	// <host file>:<image path>
+	char host_path[IMAGE_PATH_SIZE];
+	int split = 0;
+	while (source[split] != '\0' && source[split] != ':')
+		split++;
+	if (source[split] != ':' || source[split + 1] != '/') {
+		fail("expected <host file>:<image path>", source);
+		return;
+	}
+	snprintf(host_path, sizeof(host_path), "%.*s", split, source);
+	insert_file(host_path, source + split + 1);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "imagebuilder: ./imagebuilder <storage> <directory | @manifest | file:/path>...\n");
+		exit(1);
+	}
+
+	int fd = open(argv[1], O_RDWR);
+	struct stat image_stat;
+	if (fd < 0 || fstat(fd, &image_stat) != 0) {
+		fprintf(stderr, "imagebuilder: can not open %s\n", argv[1]);
+		exit(1);
+	}
+	void *image = mmap(NULL, image_stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (image == MAP_FAILED) {
+		fprintf(stderr, "imagebuilder: can not map %s\n", argv[1]);
+		exit(1);
+	}
+	ramdisk_image = image;
+	ramdisk_block_count = image_stat.st_size / BLOCK_SIZE;
+
+	// Format blank image, otherwise mount existing one
+	initialize_filesystem_fat32();
+	mount("/", &fat32_vfs);
+
+	for (int i = 2; i < argc; i++)
+		insert_source(argv[i]);
+
+	// Every file is closed already, this only catch what is left in cluster cache
+	cache_sync();
+	msync(image, image_stat.st_size, MS_SYNC);
+	munmap(image, image_stat.st_size);
+	close(fd);
+
+	if (failure_count > 0) {
+		fprintf(stderr, "imagebuilder: %d error\n", failure_count);
+		return 1;
+	}
+	return 0;
+}
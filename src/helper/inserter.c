@@ -11,14 +11,14 @@
 uint8_t *image_storage;
 uint8_t *file_buffer;
 
-void read_blocks(void *ptr, uint32_t logical_block_address, uint8_t block_count) {
-	for (int i = 0; i < block_count; i++) {
+void read_blocks(void *ptr, uint32_t logical_block_address, uint32_t block_count) {
+	for (uint32_t i = 0; i < block_count; i++) {
 		memcpy((uint8_t *)ptr + BLOCK_SIZE * i, image_storage + BLOCK_SIZE * (logical_block_address + i), BLOCK_SIZE);
 	}
 }
 
-void write_blocks(const void *ptr, uint32_t logical_block_address, uint8_t block_count) {
-	for (int i = 0; i < block_count; i++) {
+void write_blocks(const void *ptr, uint32_t logical_block_address, uint32_t block_count) {
+	for (uint32_t i = 0; i < block_count; i++) {
 		memcpy(image_storage + BLOCK_SIZE * (logical_block_address + i), (uint8_t *)ptr + BLOCK_SIZE * i, BLOCK_SIZE);
 	}
 }
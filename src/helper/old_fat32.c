@@ -21,17 +21,17 @@ const uint8_t fs_signature[BLOCK_SIZE] = {
 };
 // clang-format on
 
-struct FAT32DriverState fat32_driver_state;
+struct OldFAT32DriverState old_fat32_driver_state;
 
 uint32_t cluster_to_lba(uint32_t cluster) {
 	return cluster * CLUSTER_BLOCK_COUNT;
 };
 
-void write_clusters(const void *ptr, uint32_t cluster_number, uint8_t cluster_count) {
+void write_clusters(const void *ptr, uint32_t cluster_number, uint32_t cluster_count) {
 	write_blocks(ptr, cluster_to_lba(cluster_number), cluster_count * CLUSTER_BLOCK_COUNT);
 }
 
-void read_clusters(void *ptr, uint32_t cluster_number, uint8_t cluster_count) {
+void read_clusters(void *ptr, uint32_t cluster_number, uint32_t cluster_count) {
 	read_blocks(ptr, cluster_to_lba(cluster_number), cluster_count * CLUSTER_BLOCK_COUNT);
 };
 
@@ -54,7 +54,7 @@ static void create_empty_directory_table(struct FAT32DirectoryTable *dir_table,
 };
 
 static int8_t get_dir_table_from_cluster(uint32_t cluster, struct FAT32DirectoryTable *dir_entry) {
-	if (fat32_driver_state.fat_table.cluster_map[cluster] !=
+	if (old_fat32_driver_state.fat_table.cluster_map[cluster] !=
 			FAT32_FAT_END_OF_FILE)
 		return -1;
 	read_clusters(dir_entry, cluster, 1);
@@ -95,7 +95,7 @@ bool is_empty_storage() {
 void initialize_filesystem_fat32() {
 	if (is_empty_storage())
 		create_fat32();
-	read_clusters(&fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
+	read_clusters(&old_fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
 }
 
 int8_t read(struct FAT32DriverRequest *request) {
@@ -124,7 +124,7 @@ int8_t read(struct FAT32DriverRequest *request) {
 			while (cluster_number != FAT32_FAT_END_OF_FILE) {
 				read_clusters(ptr, cluster_number, 1);
 				cluster_number =
-						fat32_driver_state.fat_table.cluster_map[cluster_number];
+						old_fat32_driver_state.fat_table.cluster_map[cluster_number];
 				ptr += CLUSTER_SIZE;
 			}
 
@@ -202,7 +202,7 @@ int8_t write(struct FAT32DriverRequest *request) {
 	int cluster = 0;
 	int free_cluster = 0;
 	while (free_cluster < needed_cluster && cluster < CLUSTER_MAP_SIZE) {
-		uint32_t cluster_state = fat32_driver_state.fat_table.cluster_map[cluster];
+		uint32_t cluster_state = old_fat32_driver_state.fat_table.cluster_map[cluster];
 		if (cluster_state == FAT32_FAT_EMPTY_ENTRY) {
 			free_clusters[free_cluster] = cluster;
 			free_cluster++;
@@ -252,9 +252,9 @@ int8_t write(struct FAT32DriverRequest *request) {
 
 		write_clusters(src, cluster, 1);
 		src += CLUSTER_SIZE;
-		fat32_driver_state.fat_table.cluster_map[cluster] = next_cluster;
+		old_fat32_driver_state.fat_table.cluster_map[cluster] = next_cluster;
 	}
-	write_clusters(fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
+	write_clusters(old_fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
 
 	return 0;
 };
@@ -287,8 +287,8 @@ int8_t delete(struct FAT32DriverRequest *request) {
 
 	if (aFile) {
 		while (cluster != FAT32_FAT_END_OF_FILE) {
-			int next_cluster = fat32_driver_state.fat_table.cluster_map[cluster];
-			fat32_driver_state.fat_table.cluster_map[cluster] = FAT32_FAT_EMPTY_ENTRY;
+			int next_cluster = old_fat32_driver_state.fat_table.cluster_map[cluster];
+			old_fat32_driver_state.fat_table.cluster_map[cluster] = FAT32_FAT_EMPTY_ENTRY;
 			cluster = next_cluster;
 		}
 	} else {
@@ -300,12 +300,12 @@ int8_t delete(struct FAT32DriverRequest *request) {
 				return 2;
 		}
 
-		fat32_driver_state.fat_table.cluster_map[cluster] = FAT32_FAT_EMPTY_ENTRY;
+		old_fat32_driver_state.fat_table.cluster_map[cluster] = FAT32_FAT_EMPTY_ENTRY;
 	}
 
 	memset(&dir_table.table[dir_entry_index], 0x00, sizeof(struct FAT32DirectoryEntry));
 
 	write_clusters(&dir_table, request->parent_cluster_number, 1);
-	write_clusters(fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
+	write_clusters(old_fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
 	return 0;
 };
@@ -0,0 +1,95 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "driver/disk.h"
+#include "ramdisk.h"
+
+// Global variable
+uint8_t *ramdisk_image;
+uint32_t ramdisk_block_count;
+struct RamDiskCounter ramdisk_counter;
+uint32_t second_elapsed;
+
+static void copy_bytes(void *dst, const void *src, uint32_t size) {
+	for (uint32_t i = 0; i < size; i++)
+		((uint8_t *)dst)[i] = ((const uint8_t *)src)[i];
+}
+
+static uint8_t *block_address(uint32_t logical_block_address) {
+	return ramdisk_image + (uint64_t)BLOCK_SIZE * logical_block_address;
+}
+
+/* Synchronous and asynchronous interface both complete immediately */
+void read_blocks(void *ptr, uint32_t logical_block_address, uint32_t block_count) {
+	ramdisk_counter.read_command += 1;
+	ramdisk_counter.read_block += block_count;
+	copy_bytes(ptr, block_address(logical_block_address), block_count * BLOCK_SIZE);
+}
+
+void write_blocks(const void *ptr, uint32_t logical_block_address, uint32_t block_count) {
+	ramdisk_counter.write_command += 1;
+	ramdisk_counter.write_block += block_count;
+	copy_bytes(block_address(logical_block_address), ptr, block_count * BLOCK_SIZE);
+}
+
+bool read_blocks_async(
+		uint32_t logical_block_address, uint32_t block_count,
+		void *(*block_buffer)(void *closure, uint32_t index),
+		void (*complete)(void *closure, bool success), void *closure
+) {
+	ramdisk_counter.read_command += 1;
+	ramdisk_counter.read_block += block_count;
+	for (uint32_t i = 0; i < block_count; i++)
+		copy_bytes(block_buffer(closure, i), block_address(logical_block_address + i), BLOCK_SIZE);
+	complete(closure, true);
+	return true;
+}
+
+bool write_blocks_async(
+		uint32_t logical_block_address, uint32_t block_count,
+		void *(*block_buffer)(void *closure, uint32_t index),
+		void (*complete)(void *closure, bool success), void *closure
+) {
+	ramdisk_counter.write_command += 1;
+	ramdisk_counter.write_block += block_count;
+	for (uint32_t i = 0; i < block_count; i++)
+		copy_bytes(block_address(logical_block_address + i), block_buffer(closure, i), BLOCK_SIZE);
+	complete(closure, true);
+	return true;
+}
+
+uint32_t get_async_max_block(void) {
+	return ATA_LBA28_MAX_BLOCK;
+}
+
+void wait_async_blocks(void) {}
+
+bool is_disk_idle(void) {
+	return true;
+}
+
+uint32_t get_disk_block_count(void) {
+	return ramdisk_block_count;
+}
+
+void scheduler_halt_current_process(bool (*predicate)(), void *closure, bool recall) {
+	// vfs_may_block is never set outside syscall handler
+	(void)predicate;
+	(void)closure;
+	(void)recall;
+	abort();
+}
+
+// No executable image cache on host
+void exec_cache_invalidate(uint32_t location) {
+	(void)location;
+}
+
+void *kmalloc(uint32_t size) {
+	return malloc(size);
+}
+
+void kfree(void *ptr) {
+	free(ptr);
+}
@@ -0,0 +1,31 @@
+#ifndef _RAMDISK_H
+#define _RAMDISK_H
+
+#include <stdint.h>
+
+/*
+ * Host side disk for kernel file system code. Provides read_blocks,
+ * write_blocks, their asynchronous variants, kmalloc and the few kernel
+ * symbols fat32.c needs, all over image memory set up by the tool
+ */
+
+/**
+ * RamDiskCounter, block traffic since start
+ *
+ * @param read_block    Blocks read
+ * @param write_block   Blocks written
+ * @param read_command  Read calls
+ * @param write_command Write calls
+ */
+struct RamDiskCounter {
+	uint64_t read_block;
+	uint64_t write_block;
+	uint64_t read_command;
+	uint64_t write_command;
+};
+
+extern uint8_t *ramdisk_image;
+extern uint32_t ramdisk_block_count;
+extern struct RamDiskCounter ramdisk_counter;
+
+#endif
@@ -2,12 +2,14 @@
 #include "cpu/gdt.h"
 #include "cpu/idt.h"
 #include "cpu/portio.h"
+#include "driver/disk.h"
 #include "driver/keyboard.h"
 #include "driver/time.h"
 #include "driver/tty.h"
 #include "filesystem/fat32.h"
 #include "filesystem/vfs.h"
 #include "process/file_descriptor.h"
+#include "process/process.h"
 #include "process/scheduler.h"
 #include "text/buffercolor.h"
 #include "text/framebuffer.h"
@@ -61,6 +63,8 @@ void pic_remap(void) {
 struct InterruptFrame *current_interrupt_frame;
 
 bool syscall_return_value_flag = false;
+
+// User pointers are faulted in before use, program frames are not read by kernel mode fault
 void syscall_handler(struct InterruptFrame *frame) {
 	current_interrupt_frame = frame;
 #pragma GCC diagnostic ignored "-Waddress-of-packed-member"
@@ -68,16 +72,19 @@ void syscall_handler(struct InterruptFrame *frame) {
 	uint32_t first = frame->cpu.general.ebx;
 	uint32_t second = frame->cpu.general.ecx;
 	uint32_t third = frame->cpu.general.edx;
+	uint32_t fourth = frame->cpu.index.esi;
 
 	uint32_t result;
 	switch (frame->cpu.general.eax) {
 	case GET_CHAR: {
 		char *ptr = (char *)first;
+		if (!process_fault_in_user_buffer(ptr, 1)) break;
 		*ptr = fgetc();
 	} break;
 
 	case GET_CHAR_NON_BLOCKING: {
 		char *ptr = (char *)first;
+		if (!process_fault_in_user_buffer(ptr, 1)) break;
 		get_keyboard_buffer(ptr);
 	} break;
 
@@ -92,6 +99,7 @@ void syscall_handler(struct InterruptFrame *frame) {
 	case FRAMEBUFFER_PUT_CHARS: {
 		int i = second;
 		char *str = (char *)first;
+		if (!process_fault_in_user_buffer(str, i)) break;
 		while (i--) {
 			framebuffer_put(str[i]);
 			++i;
@@ -101,6 +109,7 @@ void syscall_handler(struct InterruptFrame *frame) {
 	case FRAMEBUFFER_PUT_NULL_TERMINATED_CHARS: {
 		int i = 0;
 		char *str = (char *)first;
+		if (!process_fault_in_user_string(str)) break;
 		while (str[i] != '\0') {
 			framebuffer_put(str[i]);
 			++i;
@@ -116,10 +125,13 @@ void syscall_handler(struct InterruptFrame *frame) {
 		break;
 
 	case GET_TIME:
+		if (!process_fault_in_user_buffer((void *)first, sizeof(struct TimeRTC))) break;
 		memcpy((void *)first, &current_time, sizeof(struct TimeRTC));
 		break;
 
 	case EXEC: {
+		result = -1;
+		if (!process_fault_in_user_string((char *)first)) break;
 		result = process_create((char *)first);
 	} break;
 
@@ -145,22 +157,39 @@ void syscall_handler(struct InterruptFrame *frame) {
 	} break;
 
 	case VFS_STAT: {
+		result = -1;
+		if (!process_fault_in_user_string((char *)first) || !process_fault_in_user_buffer((void *)second, sizeof(struct VFSEntry))) break;
 		result = vfs.stat((char *)first, (struct VFSEntry *)second);
 	} break;
 
 	case VFS_DIR_STAT: {
+		// Entry count is only known from directory size
+		struct VFSEntry directory;
+		result = -1;
+		if (!process_fault_in_user_string((char *)first) || vfs.stat((char *)first, &directory) != 0 || directory.type != Directory) break;
+		if (!process_fault_in_user_buffer((void *)second, directory.size * sizeof(struct VFSEntry))) break;
 		result = vfs.dirstat((char *)first, (struct VFSEntry *)second);
 	} break;
 
 	case VFS_MKDIR: {
+		result = -1;
+		if (!process_fault_in_user_string((char *)first)) break;
+		vfs_may_block = true;
 		result = vfs.mkdir((char *)first);
+		vfs_may_block = false;
 	} break;
 
 	case VFS_MKFILE: {
+		result = -1;
+		if (!process_fault_in_user_string((char *)first)) break;
+		vfs_may_block = true;
 		result = vfs.mkfile((char *)first);
+		vfs_may_block = false;
 	} break;
 
 	case VFS_OPEN: {
+		result = -1;
+		if (!process_fault_in_user_string((char *)first)) break;
 		int fd = get_free_fd_of_current_process();
 		if (fd < 0) {
 			result = fd;
@@ -178,25 +207,71 @@ void syscall_handler(struct InterruptFrame *frame) {
 	case VFS_CLOSE: {
 		int fd = (int)first;
 		int ft = get_ft_of_current_process(fd);
+		vfs_may_block = true;
 		result = vfs.close(ft);
-		if (result == 0)
+		vfs_may_block = false;
+		if (result == 0 && syscall_return_value_flag) // Parked close is restarted with the same fd
 			clear_fd_of_current_process(fd);
 	} break;
 
 	case VFS_READ: {
 		int fd = (int)first;
 		int ft = get_ft_of_current_process(fd);
+		result = -1;
+		if (!process_fault_in_user_buffer((void *)second, third)) break;
+		vfs_may_block = true;
 		result = vfs.read(ft, (char *)second, (int)third);
+		vfs_may_block = false;
 	} break;
 
 	case VFS_WRITE: {
 		int fd = (int)first;
 		int ft = get_ft_of_current_process(fd);
+		result = -1;
+		if (!process_fault_in_user_buffer((void *)second, third)) break;
+		vfs_may_block = true;
 		result = vfs.write(ft, (char *)second, (int)third);
+		vfs_may_block = false;
 	} break;
 
 	case VFS_DELETE: {
+		result = -1;
+		if (!process_fault_in_user_string((char *)first)) break;
+		vfs_may_block = true;
 		result = vfs.delete((char *)first);
+		vfs_may_block = false;
+	} break;
+
+	case VFS_FSYNC: {
+		int fd = (int)first;
+		int ft = get_ft_of_current_process(fd);
+		vfs_may_block = true;
+		result = vfs.fsync(ft);
+		vfs_may_block = false;
+	} break;
+
+	case VFS_SEEK: {
+		int fd = (int)first;
+		int ft = get_ft_of_current_process(fd);
+		result = vfs.seek(ft, (int)second, (int)third);
+	} break;
+
+	case VFS_PREAD: {
+		int fd = (int)first;
+		int ft = get_ft_of_current_process(fd);
+		result = -1;
+		if (!process_fault_in_user_buffer((void *)second, third)) break;
+		result = vfs.pread(ft, (char *)second, (int)third, (int)fourth);
+	} break;
+
+	case VFS_PWRITE: {
+		int fd = (int)first;
+		int ft = get_ft_of_current_process(fd);
+		result = -1;
+		if (!process_fault_in_user_buffer((void *)second, third)) break;
+		vfs_may_block = true;
+		result = vfs.pwrite(ft, (char *)second, (int)third, (int)fourth);
+		vfs_may_block = false;
 	} break;
 
 	default: {
@@ -217,7 +292,16 @@ void main_interrupt_handler(struct InterruptFrame frame) {
 	// }
 
 	switch (frame.int_number) {
-	case 14: { // Page fault
+	case 14: { // Page fault, program and stack frames are mapped on first touch
+		enum PageFaultStatus status = process_handle_page_fault(paging_get_fault_address(), frame.int_stack.error_code);
+		if (status == PageFaultMapped)
+			break;
+
+		// Frames are not reserved at exec, tell why the process is gone
+		if (status == PageFaultOutOfMemory) {
+			framebuffer_puts("Process killed: out of memory");
+			framebuffer_next_line();
+		}
 		int pid = get_current_running_pid();
 		scheduler_handle_timer_interrupt(&frame);
 		process_destroy(pid);
@@ -232,7 +316,12 @@ void main_interrupt_handler(struct InterruptFrame frame) {
 	case PIC1_OFFSET + IRQ_CMOS:
 		handle_rtc_interrupt();
 		break;
+	case PIC1_OFFSET + IRQ_PRIMARY_ATA:
+		disk_isr();
+		break;
 	case SYSCALL_INT:
+		// Expired metadata is written on syscall entry, tick itself never wait for disk
+		fat32_flush_expired();
 		syscall_return_value_flag = true;
 		syscall_handler(&frame);
 		break;
@@ -29,3 +29,27 @@ uint16_t in16(uint16_t port) {
 	__asm__ volatile("inw %1, %0" : "=a"(result) : "Nd"(port));
 	return result;
 }
+
+void out32(uint16_t port, uint32_t data) {
+	__asm__("outl %0, %1"
+					: // <Empty output operand>
+					: "a"(data), "Nd"(port));
+}
+uint32_t in32(uint16_t port) {
+	uint32_t result;
+	__asm__ volatile("inl %1, %0" : "=a"(result) : "Nd"(port));
+	return result;
+}
+
+void in16_repeat(uint16_t port, void *buffer, uint32_t count) {
+	__asm__ volatile("cld; rep insw"
+									 : "+D"(buffer), "+c"(count)
+									 : "d"(port)
+									 : "memory");
+}
+void out16_repeat(uint16_t port, const void *buffer, uint32_t count) {
+	__asm__ volatile("cld; rep outsw"
+									 : "+S"(buffer), "+c"(count)
+									 : "d"(port)
+									 : "memory");
+}
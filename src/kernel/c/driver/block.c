@@ -0,0 +1,151 @@
+#include "driver/block.h"
+#include "driver/disk.h"
+#include <std/stdbool.h>
+#include <std/stddef.h>
+#include <std/stdint.h>
+
+struct BlockStatistic block_statistic;
+
+static struct BlockRequest block_requests[BLOCK_REQUEST_COUNT];
+
+// LBA sorted requests waiting for disk
+static struct BlockRequest *pending_head = NULL;
+
+// Merged requests of the command in flight, in LBA order
+static struct BlockRequest *dispatched_head = NULL;
+
+// Block following the last dispatched command, C-LOOK sweep position
+static uint32_t head_position = 0;
+
+static uint32_t plug_depth = 0;
+
+static struct BlockRequest *allocate_request() {
+	for (int i = 0; i < BLOCK_REQUEST_COUNT; ++i) {
+		if (!block_requests[i].used) {
+			block_requests[i].used = true;
+			return &block_requests[i];
+		}
+	}
+	return NULL;
+}
+
+static void insert_pending(struct BlockRequest *request) {
+	struct BlockRequest **current = &pending_head;
+	while (*current != NULL && (*current)->logical_block_address <= request->logical_block_address)
+		current = &(*current)->next;
+	request->next = *current;
+	*current = request;
+}
+
+static void *dispatched_block_buffer(void *closure, uint32_t index) {
+	(void)closure;
+	struct BlockRequest *request = dispatched_head;
+	while (index >= request->block_count) {
+		index -= request->block_count;
+		request = request->next;
+	}
+	return request->buffer + index * BLOCK_SIZE;
+}
+
+static void dispatch(void);
+
+static void complete_dispatched(void *closure, bool success) {
+	(void)closure;
+	struct BlockRequest *request = dispatched_head;
+	dispatched_head = NULL;
+	while (request != NULL) {
+		struct BlockRequest *next = request->next;
+		request->used = false;
+		request->complete(request->closure, success);
+		request = next;
+	}
+	dispatch();
+}
+
+// Take first pending request at or after head_position, wrapping to the lowest LBA
+static void dispatch() {
+	if (plug_depth > 0 || pending_head == NULL || dispatched_head != NULL || !is_disk_idle())
+		return;
+
+	struct BlockRequest **first = &pending_head;
+	while (*first != NULL && (*first)->logical_block_address < head_position)
+		first = &(*first)->next;
+	if (*first == NULL)
+		first = &pending_head;
+
+	// Adjacent requests of same direction follow in sorted list, detach them together
+	uint32_t max_block = get_async_max_block();
+	if (max_block > BLOCK_MAX_MERGE_BLOCK)
+		max_block = BLOCK_MAX_MERGE_BLOCK;
+
+	struct BlockRequest *last = *first;
+	uint32_t block_count = last->block_count;
+	while (
+			last->next != NULL && last->next->write == last->write &&
+			last->next->logical_block_address == last->logical_block_address + last->block_count &&
+			block_count + last->next->block_count <= max_block
+	) {
+		last = last->next;
+		block_count += last->block_count;
+		block_statistic.merged += 1;
+	}
+
+	dispatched_head = *first;
+	*first = last->next;
+	last->next = NULL;
+
+	uint32_t logical_block_address = dispatched_head->logical_block_address;
+	head_position = logical_block_address + block_count;
+	block_statistic.dispatched += 1;
+
+	// Driver run it with bus master straight into request buffers when it can, PIO otherwise
+	bool started;
+	if (dispatched_head->write)
+		started = write_blocks_async(logical_block_address, block_count, dispatched_block_buffer, complete_dispatched, NULL);
+	else
+		started = read_blocks_async(logical_block_address, block_count, dispatched_block_buffer, complete_dispatched, NULL);
+
+	if (!started) // Too large for one command or disk refused, synchronous path still works
+		complete_dispatched(NULL, false);
+}
+
+bool block_submit(
+		bool write, void *buffer, uint32_t logical_block_address, uint32_t block_count,
+		void (*complete)(void *closure, bool success), void *closure
+) {
+	struct BlockRequest *request = allocate_request();
+	if (request == NULL)
+		return false;
+
+	request->write = write;
+	request->logical_block_address = logical_block_address;
+	request->block_count = block_count;
+	request->buffer = buffer;
+	request->complete = complete;
+	request->closure = closure;
+	insert_pending(request);
+	block_statistic.submitted += 1;
+
+	dispatch();
+	return true;
+}
+
+void block_plug() {
+	plug_depth += 1;
+}
+
+void block_unplug() {
+	plug_depth -= 1;
+	dispatch();
+}
+
+void block_wait() {
+	while (!is_block_queue_idle()) {
+		wait_async_blocks();
+		dispatch();
+	}
+}
+
+bool is_block_queue_idle() {
+	return pending_head == NULL && dispatched_head == NULL;
+}
@@ -1,44 +1,539 @@
 #include "driver/disk.h"
+#include "cpu/interrupt.h"
 #include "cpu/portio.h"
 #include "driver/disk.h"
+#include "driver/pci.h"
+#include "driver/time.h"
+#include "memory/kmalloc.h"
+#include "memory/paging.h"
+#include "process/process.h"
 #include <std/stdint.h>
+#include <std/string.h>
 static void ATA_busy_wait() {
 	while (in(0x1F7) & ATA_STATUS_BSY)
 		;
 }
 static void ATA_DRQ_wait() {
-	while (!(in(0x1F7) & ATA_STATUS_RDY))
+	while (!(in(0x1F7) & (ATA_STATUS_DRQ | ATA_STATUS_ERR)))
 		;
 }
-void read_blocks(void *ptr, uint32_t logical_block_address, uint8_t block_count) {
-	ATA_busy_wait();
-	out(0x1F6, 0xE0 | ((logical_block_address >> 24) & 0xF));
-	out(0x1F2, block_count);
+
+static struct ATADevice ata_device;
+
+static uint8_t select_command(uint8_t lba28_command, uint8_t lba48_command) {
+	return ata_device.lba48 ? lba48_command : lba28_command;
+}
+
+// Block count a single command may move, its encoding wrap the maximum to 0
+static uint32_t max_command_block() {
+	return ata_device.lba48 ? ATA_LBA48_MAX_BLOCK : ATA_LBA28_MAX_BLOCK;
+}
+
+// Blocks moved per DRQ handshake, READ/WRITE MULTIPLE once SET MULTIPLE MODE succeeded
+static uint32_t drq_block_count() {
+	return ata_device.multiple_count > 1 ? ata_device.multiple_count : 1;
+}
+
+static uint8_t read_pio_command() {
+	if (ata_device.multiple_count > 1)
+		return select_command(ATA_COMMAND_READ_MULTIPLE, ATA_COMMAND_READ_MULTIPLE_EXT);
+	return select_command(ATA_COMMAND_READ_SECTORS, ATA_COMMAND_READ_SECTORS_EXT);
+}
+
+static uint8_t write_pio_command() {
+	if (ata_device.multiple_count > 1)
+		return select_command(ATA_COMMAND_WRITE_MULTIPLE, ATA_COMMAND_WRITE_MULTIPLE_EXT);
+	return select_command(ATA_COMMAND_WRITE_SECTORS, ATA_COMMAND_WRITE_SECTORS_EXT);
+}
+
+// Load task file and start command, caller already waited for BSY and set nIEN
+static void issue_command(uint32_t logical_block_address, uint32_t block_count, uint8_t command) {
+	if (ata_device.lba48) {
+		// High order bytes first, LBA bit 32-47 are always 0
+		out(0x1F6, 0x40);
+		out(0x1F2, (uint8_t)(block_count >> 8));
+		out(0x1F3, (uint8_t)(logical_block_address >> 24));
+		out(0x1F4, 0);
+		out(0x1F5, 0);
+	} else {
+		out(0x1F6, 0xE0 | ((logical_block_address >> 24) & 0xF));
+	}
+	out(0x1F2, (uint8_t)block_count);
 	out(0x1F3, (uint8_t)logical_block_address);
 	out(0x1F4, (uint8_t)(logical_block_address >> 8));
 	out(0x1F5, (uint8_t)(logical_block_address >> 16));
-	out(0x1F7, 0x20);
-	uint16_t *target = (uint16_t *)ptr;
-	for (uint32_t i = 0; i < block_count; i++) {
+	out(0x1F7, command);
+}
+
+void initialize_disk() {
+	ATA_busy_wait();
+	out(ATA_DEVICE_CONTROL, ATA_CONTROL_NIEN);
+	out(0x1F6, 0xE0);
+	out(0x1F2, 0);
+	out(0x1F3, 0);
+	out(0x1F4, 0);
+	out(0x1F5, 0);
+	out(0x1F7, ATA_COMMAND_IDENTIFY);
+	if (in(0x1F7) == 0) // No drive
+		return;
+
+	ATA_busy_wait();
+	ATA_DRQ_wait();
+	if (in(0x1F7) & ATA_STATUS_ERR)
+		return;
+
+	uint16_t identify[HALF_BLOCK_SIZE];
+	in16_repeat(0x1F0, identify, HALF_BLOCK_SIZE);
+
+	if (identify[ATA_IDENTIFY_COMMAND_SET] & ATA_IDENTIFY_LBA48) {
+		ata_device.lba48 = true;
+		if (identify[ATA_IDENTIFY_LBA48_COUNT + 2] || identify[ATA_IDENTIFY_LBA48_COUNT + 3])
+			ata_device.block_count = 0xFFFFFFFF; // Beyond 32-bit LBA, not addressable here
+		else
+			ata_device.block_count = identify[ATA_IDENTIFY_LBA48_COUNT] |
+															 ((uint32_t)identify[ATA_IDENTIFY_LBA48_COUNT + 1] << 16);
+	} else {
+		ata_device.block_count = identify[ATA_IDENTIFY_LBA28_COUNT] |
+														 ((uint32_t)identify[ATA_IDENTIFY_LBA28_COUNT + 1] << 16);
+	}
+
+	uint32_t multiple = identify[ATA_IDENTIFY_MAX_MULTIPLE] & 0xFF;
+	if (multiple > ATA_MAX_MULTIPLE)
+		multiple = ATA_MAX_MULTIPLE;
+	if (multiple > 1) {
+		out(0x1F6, 0xE0);
+		out(0x1F2, multiple);
+		out(0x1F7, ATA_COMMAND_SET_MULTIPLE);
+		ATA_busy_wait();
+		if (!(in(0x1F7) & ATA_STATUS_ERR))
+			ata_device.multiple_count = multiple;
+	}
+}
+
+uint32_t get_disk_block_count() {
+	return ata_device.block_count;
+}
+
+struct DiskStatistic disk_statistic;
+
+static struct ATAAsyncRequest async_request;
+
+// Bounce buffer for user memory and buffers spanning unrelated frames
+static uint8_t dma_buffer[DMA_BUFFER_SIZE] __attribute__((aligned(DMA_REGION_SIZE)));
+// Aligned to its own size, table must not cross 64 KiB boundary
+static struct PhysicalRegionDescriptor prd_table[DMA_PRD_COUNT] __attribute__((aligned(DMA_PRD_COUNT * 8)));
+static uint32_t prd_count = 0;
+static uint16_t bus_master_base = 0;
+static bool dma_available = false;
+
+/**
+ * Physical address of kernel buffer, when every 4 MiB page it spans follows the previous
+ * one in physical memory
+ *
+ * @param physical Set to physical address of buffer
+ * @return         False for user memory, odd address or size, and scattered frames
+ */
+static bool contiguous_physical_address(const void *buffer, uint32_t size, uint32_t *physical) {
+	uint32_t start = (uint32_t)buffer;
+	uint32_t end = start + size;
+	if (start < KERNEL_VIRTUAL_ADDRESS_BASE || end < start || (start & 1) || (size & 1))
+		return false;
+
+	*physical = (uint32_t)paging_virtual_to_physical((void *)start);
+	for (uint32_t page = (start & ~(PAGE_FRAME_SIZE - 1)) + PAGE_FRAME_SIZE; page != 0 && page < end; page += PAGE_FRAME_SIZE) {
+		if ((uint32_t)paging_virtual_to_physical((void *)page) != *physical + (page - start))
+			return false;
+	}
+	return true;
+}
+
+// Append buffer to PRD table, split where it cross 64 KiB physical boundary
+static bool prd_append(const void *buffer, uint32_t size) {
+	uint32_t physical;
+	if (!contiguous_physical_address(buffer, size, &physical))
+		return false;
+
+	while (size > 0) {
+		if (prd_count == DMA_PRD_COUNT)
+			return false;
+		uint32_t region = DMA_REGION_SIZE - (physical & (DMA_REGION_SIZE - 1));
+		if (region > size)
+			region = size;
+		prd_table[prd_count].address = physical;
+		prd_table[prd_count].byte_count = (uint16_t)region; // 64 KiB wrap to 0
+		prd_table[prd_count].flag = 0;
+		prd_count += 1;
+		physical += region;
+		size -= region;
+	}
+	return true;
+}
+
+bool initialize_disk_dma() {
+	struct PCIDevice ide;
+	if (!pci_find_device(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide))
+		return false;
+
+	uint32_t bar4 = pci_config_read(ide, PCI_BAR4);
+	if (!(bar4 & PCI_BAR_IO) || (bar4 & 0xFFFC) == 0)
+		return false;
+
+	uint32_t command = pci_config_read(ide, PCI_COMMAND);
+	pci_config_write(ide, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+
+	bus_master_base = bar4 & 0xFFFC;
+	dma_available = true;
+	return true;
+}
+
+/**
+ * Start bus master transfer described by prd_table
+ *
+ * @param interrupt Completion raise IRQ14, otherwise caller poll BM_STATUS with nIEN set
+ */
+static void dma_start(uint32_t logical_block_address, uint32_t block_count, bool write, bool interrupt) {
+	uint8_t direction = write ? 0 : BM_COMMAND_READ;
+	prd_table[prd_count - 1].flag = PRD_END_OF_TABLE;
+
+	ATA_busy_wait();
+	out(ATA_DEVICE_CONTROL, interrupt ? 0 : ATA_CONTROL_NIEN);
+	out(bus_master_base + BM_COMMAND, direction);
+	out(bus_master_base + BM_STATUS, BM_STATUS_ERROR | BM_STATUS_INTERRUPT); // Write 1 to clear
+	out32(bus_master_base + BM_PRDT, (uint32_t)paging_virtual_to_physical(prd_table));
+
+	if (write)
+		issue_command(logical_block_address, block_count, select_command(ATA_COMMAND_WRITE_DMA, ATA_COMMAND_WRITE_DMA_EXT));
+	else
+		issue_command(logical_block_address, block_count, select_command(ATA_COMMAND_READ_DMA, ATA_COMMAND_READ_DMA_EXT));
+	out(bus_master_base + BM_COMMAND, direction | BM_COMMAND_START);
+}
+
+// Stop bus master once transfer ended, false if controller or disk report error
+static bool dma_finish(bool write) {
+	uint8_t status = in(bus_master_base + BM_STATUS);
+	out(bus_master_base + BM_COMMAND, write ? 0 : BM_COMMAND_READ);
+	out(bus_master_base + BM_STATUS, BM_STATUS_ERROR | BM_STATUS_INTERRUPT);
+
+	if ((status & BM_STATUS_ERROR) || (in(0x1F7) & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+		dma_available = false; // Do not trust controller anymore
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Move blocks between disk and buffer with bus master. PRD table point at physically
+ * contiguous kernel buffer directly, anything else is copied through dma_buffer.
+ * Synchronous caller can not sleep, completion is polled
+ *
+ * @return False if DMA is unavailable or failed, caller should fallback to PIO
+ */
+static bool dma_transfer(void *buffer, uint32_t logical_block_address, uint32_t block_count, bool write) {
+	if (!dma_available || block_count == 0)
+		return false;
+
+	uint32_t byte_count = block_count * BLOCK_SIZE;
+	prd_count = 0;
+	bool direct = prd_append(buffer, byte_count);
+	if (!direct) {
+		prd_count = 0;
+		prd_append(dma_buffer, byte_count);
+		if (write)
+			memcpy(dma_buffer, buffer, byte_count);
+	}
+
+	dma_start(logical_block_address, block_count, write, false);
+	uint8_t status;
+	do {
+		status = in(bus_master_base + BM_STATUS);
+	} while ((status & BM_STATUS_ACTIVE) && !(status & BM_STATUS_ERROR));
+	ATA_busy_wait();
+	if (!dma_finish(write))
+		return false;
+
+	if (!direct && !write)
+		memcpy(buffer, dma_buffer, byte_count);
+	if (direct)
+		disk_statistic.dma_direct += 1;
+	else
+		disk_statistic.dma_bounce += 1;
+	return true;
+}
+
+// PRD table over every block buffer of async request, adjacent blocks share one region
+static bool build_async_prd_table() {
+	prd_count = 0;
+	uint8_t *region = NULL;
+	uint32_t region_size = 0;
+	for (uint32_t i = 0; i < async_request.block_count; ++i) {
+		uint8_t *block = async_request.block_buffer(async_request.closure, i);
+		if (region != NULL && block == region + region_size) {
+			region_size += BLOCK_SIZE;
+			continue;
+		}
+		if (region != NULL && !prd_append(region, region_size))
+			return false;
+		region = block;
+		region_size = BLOCK_SIZE;
+	}
+	return prd_append(region, region_size);
+}
+
+static void finish_async_request(bool success) {
+	async_request.active = false;
+	async_request.complete(async_request.closure, success);
+}
+
+/**
+ * Serve one DRQ handshake. Read complete after storing the last blocks, write
+ * complete on the interrupt following the last blocks
+ */
+static void transfer_async_blocks() {
+	if (async_request.write && async_request.block_done == async_request.block_count) {
+		finish_async_request(true);
+		return;
+	}
+
+	uint32_t count = async_request.block_count - async_request.block_done;
+	if (count > drq_block_count())
+		count = drq_block_count();
+
+	for (uint32_t i = 0; i < count; ++i) {
+		void *block = async_request.block_buffer(async_request.closure, async_request.block_done);
+		if (async_request.write)
+			out16_repeat(0x1F0, block, HALF_BLOCK_SIZE);
+		else
+			in16_repeat(0x1F0, block, HALF_BLOCK_SIZE);
+		async_request.block_done += 1;
+	}
+
+	if (!async_request.write && async_request.block_done == async_request.block_count)
+		finish_async_request(true);
+}
+
+// Issue PIO command for async request, interrupts drive the rest
+static void start_async_pio() {
+	async_request.dma = false;
+	async_request.block_done = 0;
+	disk_statistic.pio += 1;
+
+	ATA_busy_wait();
+	out(ATA_DEVICE_CONTROL, 0);
+	issue_command(
+			async_request.logical_block_address, async_request.block_count,
+			async_request.write ? write_pio_command() : read_pio_command()
+	);
+	if (async_request.write) { // No interrupt before the first handshake
 		ATA_busy_wait();
 		ATA_DRQ_wait();
-		for (uint32_t j = 0; j < HALF_BLOCK_SIZE; j++)
-			target[j] = in16(0x1F0);
-		target += HALF_BLOCK_SIZE;
+		if (in(0x1F7) & ATA_STATUS_ERR)
+			finish_async_request(false);
+		else
+			transfer_async_blocks();
+	}
+}
+
+// Bus master transfer ended, failed one is repeated with PIO like read_blocks() does
+static void finish_async_dma() {
+	if (dma_finish(async_request.write))
+		finish_async_request(true);
+	else
+		start_async_pio();
+}
+
+void wait_async_blocks() {
+	while (async_request.active) {
+		if (async_request.dma) {
+			uint8_t status;
+			do {
+				status = in(bus_master_base + BM_STATUS);
+			} while ((status & BM_STATUS_ACTIVE) && !(status & BM_STATUS_ERROR));
+			ATA_busy_wait();
+			finish_async_dma();
+			continue;
+		}
+
+		ATA_busy_wait();
+		if (in(0x1F7) & ATA_STATUS_ERR) {
+			finish_async_request(false);
+			continue;
+		}
+		if (!(async_request.write && async_request.block_done == async_request.block_count))
+			ATA_DRQ_wait();
+		transfer_async_blocks();
+	}
+}
+
+bool is_disk_idle() {
+	return !async_request.active;
+}
+
+uint32_t get_async_max_block() {
+	return max_command_block();
+}
+
+static bool start_async_request(
+		bool write, uint32_t logical_block_address, uint32_t block_count,
+		void *(*block_buffer)(void *closure, uint32_t index),
+		void (*complete)(void *closure, bool success), void *closure
+) {
+	if (async_request.active || block_count == 0 || block_count > max_command_block())
+		return false;
+
+	async_request.active = true;
+	async_request.write = write;
+	async_request.logical_block_address = logical_block_address;
+	async_request.block_count = block_count;
+	async_request.block_done = 0;
+	async_request.block_buffer = block_buffer;
+	async_request.complete = complete;
+	async_request.closure = closure;
+
+	// Completion is one IRQ14, CPU is free for the whole transfer
+	async_request.dma = dma_available && build_async_prd_table();
+	if (async_request.dma) {
+		disk_statistic.dma_direct += 1;
+		dma_start(logical_block_address, block_count, write, true);
+	} else {
+		start_async_pio();
+	}
+	return true;
+}
+
+bool read_blocks_async(
+		uint32_t logical_block_address, uint32_t block_count,
+		void *(*block_buffer)(void *closure, uint32_t index),
+		void (*complete)(void *closure, bool success), void *closure
+) {
+	return start_async_request(false, logical_block_address, block_count, block_buffer, complete, closure);
+}
+
+bool write_blocks_async(
+		uint32_t logical_block_address, uint32_t block_count,
+		void *(*block_buffer)(void *closure, uint32_t index),
+		void (*complete)(void *closure, bool success), void *closure
+) {
+	return start_async_request(true, logical_block_address, block_count, block_buffer, complete, closure);
+}
+
+void activate_disk_interrupt() {
+	out(PIC1_DATA, in(PIC1_DATA) & ~(1 << IRQ_CASCADE));
+	out(PIC2_DATA, in(PIC2_DATA) & ~(1 << (IRQ_PRIMARY_ATA - 8)));
+}
+
+void disk_isr() {
+	uint8_t status = in(0x1F7); // Reading status also acknowledge the device
+	if (async_request.active && async_request.dma) {
+		uint8_t bus_master_status = in(bus_master_base + BM_STATUS);
+		bool ended = !(bus_master_status & BM_STATUS_ACTIVE) || (bus_master_status & BM_STATUS_ERROR);
+		if (ended && !(status & ATA_STATUS_BSY))
+			finish_async_dma();
+	} else if (async_request.active && !(status & ATA_STATUS_BSY)) {
+		if (status & ATA_STATUS_ERR)
+			finish_async_request(false);
+		else if ((status & ATA_STATUS_DRQ) || async_request.block_done == async_request.block_count)
+			transfer_async_blocks();
 	}
+	pic_ack(IRQ_PRIMARY_ATA);
+}
+
+static uint32_t min_block(uint32_t a, uint32_t b) {
+	return a < b ? a : b;
 }
-void write_blocks(const void *ptr, uint32_t logical_block_address, uint8_t block_count) {
+
+static void read_blocks_pio(uint16_t *target, uint32_t logical_block_address, uint32_t block_count) {
+	disk_statistic.pio += 1;
 	ATA_busy_wait();
-	out(0x1F6, 0xE0 | ((logical_block_address >> 24) & 0xF));
-	out(0x1F2, block_count);
-	out(0x1F3, (uint8_t)logical_block_address);
-	out(0x1F4, (uint8_t)(logical_block_address >> 8));
-	out(0x1F5, (uint8_t)(logical_block_address >> 16));
-	out(0x1F7, 0x30);
-	for (uint32_t i = 0; i < block_count; i++) {
+	out(ATA_DEVICE_CONTROL, ATA_CONTROL_NIEN);
+	issue_command(logical_block_address, block_count, read_pio_command());
+	for (uint32_t done = 0; done < block_count;) {
+		uint32_t count = min_block(block_count - done, drq_block_count());
+		ATA_busy_wait();
+		ATA_DRQ_wait();
+		in16_repeat(0x1F0, target, count * HALF_BLOCK_SIZE);
+		target += count * HALF_BLOCK_SIZE;
+		done += count;
+	}
+}
+
+static void write_blocks_pio(const uint16_t *source, uint32_t logical_block_address, uint32_t block_count) {
+	disk_statistic.pio += 1;
+	ATA_busy_wait();
+	out(ATA_DEVICE_CONTROL, ATA_CONTROL_NIEN);
+	issue_command(logical_block_address, block_count, write_pio_command());
+	for (uint32_t done = 0; done < block_count;) {
+		uint32_t count = min_block(block_count - done, drq_block_count());
 		ATA_busy_wait();
 		ATA_DRQ_wait();
-		for (uint32_t j = 0; j < HALF_BLOCK_SIZE; j++)
-			out16(0x1F0, ((uint16_t *)ptr)[HALF_BLOCK_SIZE * i + j]);
+		out16_repeat(0x1F0, source, count * HALF_BLOCK_SIZE);
+		source += count * HALF_BLOCK_SIZE;
+		done += count;
+	}
+	ATA_busy_wait();
+}
+
+void read_blocks(void *ptr, uint32_t logical_block_address, uint32_t block_count) {
+	wait_async_blocks();
+	uint8_t *target = ptr;
+	while (block_count > 0) {
+		uint32_t count = min_block(block_count, max_command_block());
+		if (dma_available && count > DMA_BUFFER_SIZE / BLOCK_SIZE)
+			count = DMA_BUFFER_SIZE / BLOCK_SIZE;
+
+		if (!dma_transfer(target, logical_block_address, count, false))
+			read_blocks_pio((uint16_t *)target, logical_block_address, count);
+
+		target += count * BLOCK_SIZE;
+		logical_block_address += count;
+		block_count -= count;
+	}
+}
+
+void write_blocks(const void *ptr, uint32_t logical_block_address, uint32_t block_count) {
+	wait_async_blocks();
+	const uint8_t *source = ptr;
+	while (block_count > 0) {
+		uint32_t count = min_block(block_count, max_command_block());
+		if (dma_available && count > DMA_BUFFER_SIZE / BLOCK_SIZE)
+			count = DMA_BUFFER_SIZE / BLOCK_SIZE;
+
+		if (!dma_transfer((void *)source, logical_block_address, count, true))
+			write_blocks_pio((const uint16_t *)source, logical_block_address, count);
+
+		source += count * BLOCK_SIZE;
+		logical_block_address += count;
+		block_count -= count;
+	}
+}
+
+uint32_t disk_benchmark_sequential_read(uint32_t block_count, bool dma) {
+	if (block_count > ata_device.block_count)
+		block_count = ata_device.block_count;
+	if (block_count == 0 || (dma && !dma_available))
+		return 0;
+
+	// Heap memory of base region is physically contiguous, DMA run take direct path
+	void *buffer = kmalloc(DMA_BUFFER_SIZE);
+	if (buffer == NULL)
+		return 0;
+
+	bool dma_was_available = dma_available;
+	dma_available = dma;
+	uint64_t start = read_timestamp_counter();
+	for (uint32_t done = 0; done < block_count;) {
+		uint32_t count = min_block(block_count - done, DMA_BUFFER_SIZE / BLOCK_SIZE);
+		read_blocks(buffer, done, count);
+		done += count;
 	}
+	uint64_t elapsed = read_timestamp_counter() - start;
+	if (!dma) // DMA run may have disabled it on error, keep that
+		dma_available = dma_was_available;
+	kfree(buffer);
+
+	// No 64-bit division without libgcc, scale both sides down by 1024
+	uint32_t khz = get_timestamp_counter_khz() >> 10;
+	uint32_t millisecond = khz == 0 ? 0 : (uint32_t)(elapsed >> 10) / khz;
+	if (millisecond == 0)
+		millisecond = 1;
+	return block_count / (1024 / BLOCK_SIZE) * 1000 / millisecond;
 }
@@ -0,0 +1,45 @@
+#include "driver/pci.h"
+#include "cpu/portio.h"
+#include <std/stdbool.h>
+#include <std/stdint.h>
+
+static uint32_t config_address(struct PCIDevice device, uint8_t offset) {
+	return 0x80000000 | ((uint32_t)device.bus << 16) | ((uint32_t)device.slot << 11) |
+				 ((uint32_t)device.function << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_config_read(struct PCIDevice device, uint8_t offset) {
+	out32(PCI_CONFIG_ADDRESS, config_address(device, offset));
+	return in32(PCI_CONFIG_DATA);
+}
+
+void pci_config_write(struct PCIDevice device, uint8_t offset, uint32_t value) {
+	out32(PCI_CONFIG_ADDRESS, config_address(device, offset));
+	out32(PCI_CONFIG_DATA, value);
+}
+
+bool pci_find_device(uint8_t class_code, uint8_t subclass, struct PCIDevice *result) {
+	for (uint32_t bus = 0; bus < PCI_BUS_COUNT; ++bus) {
+		for (uint32_t slot = 0; slot < PCI_SLOT_COUNT; ++slot) {
+			struct PCIDevice device = {.bus = bus, .slot = slot, .function = 0};
+			if ((pci_config_read(device, PCI_VENDOR_ID) & 0xFFFF) == PCI_VENDOR_NONE) continue;
+
+			// Only multifunction device has function 1-7
+			uint32_t function_count = 1;
+			if ((pci_config_read(device, PCI_HEADER_TYPE) >> 16) & PCI_HEADER_MULTIFUNCTION)
+				function_count = PCI_FUNCTION_COUNT;
+
+			for (uint32_t function = 0; function < function_count; ++function) {
+				device.function = function;
+				if ((pci_config_read(device, PCI_VENDOR_ID) & 0xFFFF) == PCI_VENDOR_NONE) continue;
+
+				uint32_t class = pci_config_read(device, PCI_CLASS);
+				if ((class >> 24) == class_code && ((class >> 16) & 0xFF) == subclass) {
+					*result = device;
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
@@ -72,6 +72,42 @@ void time_handle_timer_interrupt() {
 	interrupt_counter += 1;
 };
 
+uint64_t read_timestamp_counter() {
+	uint64_t counter;
+	__asm__ volatile("rdtsc" : "=A"(counter));
+	return counter;
+}
+
+// PIT channel 2 one shot gated through port 0x61, channel 0 keeps driving scheduler
+#define PIT_CHANNEL_2_DATA_PIO 0x42
+#define PIT_CHANNEL_2_GATE_PIO 0x61
+#define PIT_CHANNEL_2_GATE 0x01
+#define PIT_CHANNEL_2_SPEAKER 0x02
+#define PIT_CHANNEL_2_OUTPUT 0x20
+#define PIT_CHANNEL_2_ONE_SHOT 0xB0
+#define TSC_CALIBRATE_MILLISECOND 10
+
+uint32_t get_timestamp_counter_khz() {
+	static uint32_t khz = 0;
+	if (khz != 0)
+		return khz;
+
+	uint8_t gate = in(PIT_CHANNEL_2_GATE_PIO);
+	out(PIT_CHANNEL_2_GATE_PIO, (gate & ~PIT_CHANNEL_2_SPEAKER) | PIT_CHANNEL_2_GATE);
+	out(PIT_COMMAND_REGISTER_PIO, PIT_CHANNEL_2_ONE_SHOT);
+	uint16_t count = PIT_MAX_FREQUENCY / 1000 * TSC_CALIBRATE_MILLISECOND;
+	out(PIT_CHANNEL_2_DATA_PIO, (uint8_t)count);
+	out(PIT_CHANNEL_2_DATA_PIO, (uint8_t)(count >> 8));
+
+	uint64_t start = read_timestamp_counter();
+	while (!(in(PIT_CHANNEL_2_GATE_PIO) & PIT_CHANNEL_2_OUTPUT))
+		;
+	khz = (uint32_t)(read_timestamp_counter() - start) / TSC_CALIBRATE_MILLISECOND;
+
+	out(PIT_CHANNEL_2_GATE_PIO, gate);
+	return khz;
+}
+
 void enable_rtc_interrupt() {
 	__asm__ volatile("cli");
 
@@ -0,0 +1,295 @@
+#include "filesystem/cache.h"
+#include "driver/block.h"
+#include "driver/disk.h"
+#include <fat32.h>
+#include <std/stdbool.h>
+#include <std/stddef.h>
+#include <std/stdint.h>
+#include <std/string.h>
+
+struct CacheStatistic cache_statistic;
+
+static struct CacheEntry cache_entries[CACHE_ENTRY_COUNT];
+static struct CacheEntry *cache_bucket[CACHE_BUCKET_COUNT];
+
+// Most recently used entry on lru_head, eviction candidate on lru_tail
+static struct CacheEntry *lru_head = NULL;
+static struct CacheEntry *lru_tail = NULL;
+
+// Entries waiting for their read on block request queue
+static uint32_t loading_count = 0;
+
+// Entries waiting for their write back on block request queue
+static uint32_t writing_count = 0;
+
+static void initialize_cache() {
+	for (int i = 0; i < CACHE_ENTRY_COUNT; ++i) {
+		struct CacheEntry *entry = &cache_entries[i];
+		entry->cluster = CACHE_EMPTY_CLUSTER;
+		entry->dirty = false;
+		entry->loading = false;
+		entry->writing = false;
+		entry->write_failed = false;
+		entry->hash_next = NULL;
+		entry->lru_prev = i == 0 ? NULL : &cache_entries[i - 1];
+		entry->lru_next = i == CACHE_ENTRY_COUNT - 1 ? NULL : &cache_entries[i + 1];
+	}
+	lru_head = &cache_entries[0];
+	lru_tail = &cache_entries[CACHE_ENTRY_COUNT - 1];
+}
+
+static uint32_t hash_cluster(uint32_t cluster) {
+	return cluster % CACHE_BUCKET_COUNT;
+}
+
+static uint32_t min_run(uint32_t count) {
+	return count < CACHE_MAX_RUN_CLUSTER ? count : CACHE_MAX_RUN_CLUSTER;
+}
+
+static struct CacheEntry *find_entry(uint32_t cluster) {
+	struct CacheEntry *entry = cache_bucket[hash_cluster(cluster)];
+	while (entry != NULL) {
+		if (entry->cluster == cluster) return entry;
+		entry = entry->hash_next;
+	}
+	return NULL;
+}
+
+static void unlink_bucket(struct CacheEntry *entry) {
+	struct CacheEntry **current = &cache_bucket[hash_cluster(entry->cluster)];
+	while (*current != NULL) {
+		if (*current == entry) {
+			*current = entry->hash_next;
+			break;
+		}
+		current = &(*current)->hash_next;
+	}
+	entry->hash_next = NULL;
+}
+
+static void touch_entry(struct CacheEntry *entry) {
+	if (entry == lru_head) return;
+
+	// Detach
+	entry->lru_prev->lru_next = entry->lru_next;
+	if (entry->lru_next != NULL)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		lru_tail = entry->lru_prev;
+
+	// Push front
+	entry->lru_prev = NULL;
+	entry->lru_next = lru_head;
+	lru_head->lru_prev = entry;
+	lru_head = entry;
+}
+
+// Synchronous users must never see a loading entry, wait for its read to end
+static struct CacheEntry *find_loaded_entry(uint32_t cluster) {
+	struct CacheEntry *entry = find_entry(cluster);
+	if (entry != NULL && entry->loading) {
+		block_wait();
+		entry = find_entry(cluster); // Failed read drop the entry
+	}
+	return entry;
+}
+
+static void write_back(struct CacheEntry *entry) {
+	if (!entry->dirty) return;
+	write_blocks(entry->buf, entry->cluster * CLUSTER_BLOCK_COUNT, CLUSTER_BLOCK_COUNT);
+	entry->dirty = false;
+	entry->write_failed = false;
+	cache_statistic.writeback += 1;
+}
+
+// Least recently used entry whose buffer is not owned by block request queue
+static struct CacheEntry *find_victim(bool clean) {
+	for (struct CacheEntry *entry = lru_tail; entry != NULL; entry = entry->lru_prev) {
+		if (!entry->loading && !entry->writing && (!clean || !entry->dirty))
+			return entry;
+	}
+	return NULL;
+}
+
+// Reuse least recently used entry for cluster, clean one first, dirty one is flushed before reuse
+static struct CacheEntry *claim_entry(uint32_t cluster) {
+	if (lru_head == NULL)
+		initialize_cache();
+
+	struct CacheEntry *entry = find_victim(true);
+	if (entry == NULL)
+		entry = find_victim(false);
+	if (entry == NULL) { // Every buffer is on block request queue
+		block_wait();
+		entry = find_victim(false);
+	}
+	if (entry->cluster != CACHE_EMPTY_CLUSTER) {
+		write_back(entry);
+		unlink_bucket(entry);
+		cache_statistic.eviction += 1;
+	}
+
+	entry->cluster = cluster;
+	entry->dirty = false;
+	uint32_t bucket = hash_cluster(cluster);
+	entry->hash_next = cache_bucket[bucket];
+	cache_bucket[bucket] = entry;
+	touch_entry(entry);
+	return entry;
+}
+
+void cache_read_cluster(void *ptr, uint32_t cluster) {
+	struct CacheEntry *entry = find_loaded_entry(cluster);
+	if (entry != NULL) {
+		cache_statistic.hit += 1;
+		touch_entry(entry);
+	} else {
+		cache_statistic.miss += 1;
+		entry = claim_entry(cluster);
+		read_blocks(entry->buf, cluster * CLUSTER_BLOCK_COUNT, CLUSTER_BLOCK_COUNT);
+	}
+	memcpy(ptr, entry->buf, CLUSTER_SIZE);
+}
+
+void cache_read_clusters_direct(void *ptr, uint32_t cluster, uint32_t count) {
+	uint8_t *target = ptr;
+	uint32_t i = 0;
+	while (i < count) {
+		struct CacheEntry *entry = find_loaded_entry(cluster + i);
+		if (entry != NULL) {
+			cache_statistic.hit += 1;
+			memcpy(target + i * CLUSTER_SIZE, entry->buf, CLUSTER_SIZE);
+			i += 1;
+			continue;
+		}
+
+		uint32_t run = 1;
+		while (i + run < count && run < CACHE_MAX_RUN_CLUSTER && find_entry(cluster + i + run) == NULL)
+			run += 1;
+
+		cache_statistic.miss += run;
+		read_blocks(target + i * CLUSTER_SIZE, (cluster + i) * CLUSTER_BLOCK_COUNT, run * CLUSTER_BLOCK_COUNT);
+		i += run;
+	}
+}
+
+void cache_write_cluster(const void *ptr, uint32_t cluster) {
+	struct CacheEntry *entry = find_loaded_entry(cluster);
+	if (entry != NULL)
+		touch_entry(entry);
+	else
+		entry = claim_entry(cluster);
+
+	memcpy(entry->buf, ptr, CLUSTER_SIZE);
+	entry->dirty = true;
+}
+
+void cache_write_clusters_direct(const void *ptr, uint32_t cluster, uint32_t count) {
+	const uint8_t *source = ptr;
+	for (uint32_t i = 0; i < count; ++i) {
+		struct CacheEntry *entry = find_loaded_entry(cluster + i);
+		if (entry == NULL) continue;
+		memcpy(entry->buf, source + i * CLUSTER_SIZE, CLUSTER_SIZE);
+		entry->dirty = false;
+		entry->write_failed = false;
+	}
+
+	uint32_t i = 0;
+	while (i < count) {
+		uint32_t run = min_run(count - i);
+		write_blocks(source + i * CLUSTER_SIZE, (cluster + i) * CLUSTER_BLOCK_COUNT, run * CLUSTER_BLOCK_COUNT);
+		i += run;
+	}
+}
+
+static void complete_write_back(void *closure, bool success) {
+	struct CacheEntry *entry = closure;
+	entry->writing = false;
+	writing_count -= 1;
+	if (!success) { // Retried synchronously by cache_sync() or eviction
+		entry->dirty = true;
+		entry->write_failed = true;
+	}
+}
+
+void cache_write_back_async(void) {
+	if (lru_head == NULL) return;
+
+	// Let request queue sort and merge adjacent dirty clusters
+	block_plug();
+	for (int i = 0; i < CACHE_ENTRY_COUNT; ++i) {
+		struct CacheEntry *entry = &cache_entries[i];
+		if (!entry->dirty || entry->writing || entry->write_failed) continue;
+		if (!block_submit(true, entry->buf, entry->cluster * CLUSTER_BLOCK_COUNT, CLUSTER_BLOCK_COUNT, complete_write_back, entry))
+			break;
+		entry->dirty = false;
+		entry->writing = true;
+		writing_count += 1;
+		cache_statistic.writeback += 1;
+	}
+	block_unplug();
+}
+
+bool cache_is_written(void *closure) {
+	(void)closure;
+	return writing_count == 0;
+}
+
+bool cache_has_clean_entry(void *closure) {
+	(void)closure;
+	return lru_head == NULL || find_victim(true) != NULL;
+}
+
+void cache_sync(void) {
+	if (lru_head == NULL) return;
+	cache_write_back_async();
+	block_wait();
+
+	for (int i = 0; i < CACHE_ENTRY_COUNT; ++i)
+		write_back(&cache_entries[i]);
+}
+
+bool cache_is_ready(uint32_t cluster) {
+	struct CacheEntry *entry = find_entry(cluster);
+	return entry != NULL && !entry->loading;
+}
+
+// Drop entry that could not be loaded, next reader fetch it synchronously
+static void drop_entry(struct CacheEntry *entry) {
+	unlink_bucket(entry);
+	entry->cluster = CACHE_EMPTY_CLUSTER;
+}
+
+static void complete_loading(void *closure, bool success) {
+	struct CacheEntry *entry = closure;
+	entry->loading = false;
+	loading_count -= 1;
+	if (!success)
+		drop_entry(entry);
+}
+
+bool cache_prefetch_async(uint32_t cluster, uint32_t count) {
+	block_plug();
+	for (uint32_t i = 0; i < count && i < CACHE_ASYNC_MAX_CLUSTER && loading_count < CACHE_MAX_LOADING; ++i) {
+		if (find_entry(cluster + i) != NULL) continue;
+
+		// One request per cluster, queue merge them back into one command
+		struct CacheEntry *entry = claim_entry(cluster + i);
+		entry->loading = true;
+		loading_count += 1;
+		if (!block_submit(false, entry->buf, (cluster + i) * CLUSTER_BLOCK_COUNT, CLUSTER_BLOCK_COUNT, complete_loading, entry)) {
+			entry->loading = false;
+			loading_count -= 1;
+			drop_entry(entry);
+			break;
+		}
+		cache_statistic.miss += 1;
+	}
+	block_unplug();
+	return find_entry(cluster) != NULL;
+}
+
+bool cache_is_loaded(void *closure) {
+	struct CacheEntry *entry = find_entry(*(uint32_t *)closure);
+	return entry == NULL || !entry->loading;
+}
@@ -0,0 +1,84 @@
+#include "filesystem/dentry.h"
+#include <std/stdbool.h>
+#include <std/stdint.h>
+#include <std/string.h>
+
+static struct DentryCacheEntry dentry_cache[DENTRY_CACHE_SIZE];
+
+// FNV-1a over parent cluster and name, slot is direct mapped
+static uint32_t hash_dentry(uint32_t parent_cluster, char *name) {
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < 4; ++i) {
+		hash ^= (parent_cluster >> (i * 8)) & 0xFF;
+		hash *= 16777619u;
+	}
+	for (int i = 0; name[i] != '\0'; ++i) {
+		hash ^= (uint8_t)name[i];
+		hash *= 16777619u;
+	}
+	return hash % DENTRY_CACHE_SIZE;
+}
+
+static bool is_cacheable(char *name) {
+	return str_len(name) < DENTRY_NAME_SIZE;
+}
+
+static bool match(struct DentryCacheEntry *entry, uint32_t parent_cluster, char *name) {
+	return entry->used && entry->parent_cluster == parent_cluster && strcmp(entry->name, name) == 0;
+}
+
+bool dentry_lookup(uint32_t parent_cluster, char *name, struct DentryCacheEntry *result) {
+	if (!is_cacheable(name))
+		return false;
+
+	struct DentryCacheEntry *entry = &dentry_cache[hash_dentry(parent_cluster, name)];
+	if (!match(entry, parent_cluster, name))
+		return false;
+
+	memcpy(result, entry, sizeof(struct DentryCacheEntry));
+	return true;
+}
+
+static struct DentryCacheEntry *fill_slot(uint32_t parent_cluster, char *name) {
+	struct DentryCacheEntry *entry = &dentry_cache[hash_dentry(parent_cluster, name)];
+	entry->used = true;
+	entry->parent_cluster = parent_cluster;
+	strcpy(entry->name, name, DENTRY_NAME_SIZE);
+	return entry;
+}
+
+void dentry_insert(uint32_t parent_cluster, char *name, uint32_t table_cluster, uint32_t directory_index, uint32_t cluster, uint8_t attribute) {
+	if (!is_cacheable(name))
+		return;
+
+	struct DentryCacheEntry *entry = fill_slot(parent_cluster, name);
+	entry->negative = false;
+	entry->table_cluster = table_cluster;
+	entry->directory_index = directory_index;
+	entry->cluster = cluster;
+	entry->attribute = attribute;
+}
+
+void dentry_insert_negative(uint32_t parent_cluster, char *name) {
+	if (!is_cacheable(name))
+		return;
+
+	struct DentryCacheEntry *entry = fill_slot(parent_cluster, name);
+	entry->negative = true;
+}
+
+void dentry_invalidate(uint32_t parent_cluster, char *name) {
+	if (!is_cacheable(name))
+		return;
+
+	struct DentryCacheEntry *entry = &dentry_cache[hash_dentry(parent_cluster, name)];
+	if (match(entry, parent_cluster, name))
+		entry->used = false;
+}
+
+void dentry_invalidate_directory(uint32_t parent_cluster) {
+	for (int i = 0; i < DENTRY_CACHE_SIZE; ++i) {
+		if (dentry_cache[i].parent_cluster == parent_cluster)
+			dentry_cache[i].used = false;
+	}
+}
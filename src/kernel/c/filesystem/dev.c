@@ -271,6 +271,7 @@ static void file_stat(int index, struct VFSEntry *entry) {
 	strcpy(entry->name, dev_file_handlers[index].name, MAX_VFS_NAME);
 	entry->size = 0;
 	entry->type = File;
+	entry->location = 0;
 }
 
 static int stat(char *p, struct VFSEntry *entry) {
@@ -280,6 +281,7 @@ static int stat(char *p, struct VFSEntry *entry) {
 		strcpy(entry->name, "dev", MAX_VFS_NAME);
 		entry->type = Directory;
 		entry->size = FILE_COUNT;
+		entry->location = 0;
 		return 0;
 	}
 
@@ -1,6 +1,13 @@
 #include "filesystem/fat32.h"
+#include "driver/block.h"
 #include "driver/disk.h"
+#include "driver/time.h"
+#include "filesystem/cache.h"
+#include "filesystem/dentry.h"
+#include "filesystem/vfs.h"
 #include "memory/kmalloc.h"
+#include "process/exec_cache.h"
+#include "process/scheduler.h"
 #include "text/framebuffer.h"
 #include <fat32.h>
 #include <std/stdbool.h>
@@ -23,16 +30,231 @@ const uint8_t fs_signature[BLOCK_SIZE] = {
 
 struct FAT32DriverState fat32_driver_state;
 
+/*
+ * FAT sector cache, direct mapped by FAT sector number so neighbouring
+ * sectors sit in neighbouring slots and can be written in one command
+ */
+#define FAT_SECTOR_EMPTY 0xFFFFFFFF
+static uint32_t fat_sector_number[FAT_SECTOR_CACHE_SIZE];
+static bool fat_sector_dirty[FAT_SECTOR_CACHE_SIZE];
+static bool fat_sector_writing[FAT_SECTOR_CACHE_SIZE]; // Buffer is on block request queue
+static bool fat_sector_failed[FAT_SECTOR_CACHE_SIZE];  // Left for synchronous flush_fat()
+static uint32_t fat_writing_count = 0;
+static uint32_t fat_sector_buf[FAT_SECTOR_CACHE_SIZE][FAT_SECTOR_ENTRY_COUNT];
+static bool fat_dirty = false; // Some FAT sector is newer than disk, written by flush_fat()
+static uint32_t size_dirty_count = 0; // Opened files whose filesize is not in directory entry yet
+// Oldest unwritten FAT or filesize change, one timestamp for all metadata
+static uint32_t metadata_dirty_since = 0;
+
+static bool is_metadata_dirty() {
+	return fat_dirty || size_dirty_count > 0;
+}
+
+// Call before making metadata dirty, age count from first change since last clean state
+static void mark_metadata_dirty() {
+	if (!is_metadata_dirty())
+		metadata_dirty_since = second_elapsed;
+}
+
+static void reset_fat_sector_cache() {
+	for (int i = 0; i < FAT_SECTOR_CACHE_SIZE; ++i) {
+		fat_sector_number[i] = FAT_SECTOR_EMPTY;
+		fat_sector_dirty[i] = false;
+		fat_sector_writing[i] = false;
+		fat_sector_failed[i] = false;
+	}
+}
+
+static uint32_t fat_sector_to_lba(uint32_t sector) {
+	uint32_t page = sector / CLUSTER_BLOCK_COUNT;
+	return cluster_to_lba(fat32_driver_state.fat_page_cluster[page]) + sector % CLUSTER_BLOCK_COUNT;
+}
+
+static uint32_t *load_fat_sector(uint32_t sector, bool dirty) {
+	uint32_t slot = sector % FAT_SECTOR_CACHE_SIZE;
+	if (fat_sector_number[slot] != sector) {
+		if (fat_sector_writing[slot]) // Buffer still owned by block request queue
+			block_wait();
+		if (fat_sector_dirty[slot])
+			write_blocks(fat_sector_buf[slot], fat_sector_to_lba(fat_sector_number[slot]), 1);
+		fat_sector_failed[slot] = false;
+		read_blocks(fat_sector_buf[slot], fat_sector_to_lba(sector), 1);
+		fat_sector_number[slot] = sector;
+		fat_sector_dirty[slot] = false;
+	}
+	fat_sector_dirty[slot] |= dirty;
+	return fat_sector_buf[slot];
+}
+
+// Cluster past FAT, only found in corrupt chain, read as end of chain so chain walk stop
+static uint32_t get_fat_entry(uint32_t cluster) {
+	if (cluster >= fat32_driver_state.cluster_count)
+		return FAT32_FAT_END_OF_FILE;
+	return load_fat_sector(cluster / FAT_SECTOR_ENTRY_COUNT, false)[cluster % FAT_SECTOR_ENTRY_COUNT];
+}
+
+static void set_fat_entry(uint32_t cluster, uint32_t value) {
+	if (cluster >= fat32_driver_state.cluster_count)
+		return;
+	load_fat_sector(cluster / FAT_SECTOR_ENTRY_COUNT, true)[cluster % FAT_SECTOR_ENTRY_COUNT] = value;
+	mark_metadata_dirty();
+	fat_dirty = true;
+}
+
+// FAT bypass cluster cache, only dirty sectors are written, consecutive ones in one command
+static void flush_fat() {
+	if (fat_writing_count > 0) // Failed asynchronous write mark its sector dirty again
+		block_wait();
+
+	int slot = 0;
+	while (slot < FAT_SECTOR_CACHE_SIZE) {
+		if (!fat_sector_dirty[slot]) {
+			slot += 1;
+			continue;
+		}
+
+		uint32_t lba = fat_sector_to_lba(fat_sector_number[slot]);
+		int run = 1;
+		while (
+				slot + run < FAT_SECTOR_CACHE_SIZE && fat_sector_dirty[slot + run] &&
+				fat_sector_to_lba(fat_sector_number[slot + run]) == lba + run
+		)
+			run += 1;
+
+		write_blocks(fat_sector_buf[slot], lba, run);
+		for (int i = 0; i < run; ++i) {
+			fat_sector_dirty[slot + i] = false;
+			fat_sector_failed[slot + i] = false;
+		}
+		slot += run;
+	}
+	fat_dirty = false;
+}
+
+static void complete_fat_sector_write(void *closure, bool success) {
+	uint32_t slot = (uint32_t *)closure - fat_sector_number; // Closure point at slot sector number
+	fat_sector_writing[slot] = false;
+	fat_writing_count -= 1;
+	if (!success) {
+		fat_sector_dirty[slot] = true;
+		fat_sector_failed[slot] = true;
+		fat_dirty = true;
+	}
+}
+
+// Queue dirty FAT sectors without waiting, request queue merge neighbouring sectors into one command
+static void flush_fat_async() {
+	block_plug();
+	for (uint32_t slot = 0; slot < FAT_SECTOR_CACHE_SIZE; ++slot) {
+		if (!fat_sector_dirty[slot] || fat_sector_writing[slot] || fat_sector_failed[slot])
+			continue;
+		uint32_t lba = fat_sector_to_lba(fat_sector_number[slot]);
+		if (!block_submit(true, fat_sector_buf[slot], lba, 1, complete_fat_sector_write, &fat_sector_number[slot]))
+			break;
+		fat_sector_dirty[slot] = false;
+		fat_sector_writing[slot] = true;
+		fat_writing_count += 1;
+	}
+	block_unplug();
+
+	fat_dirty = false;
+	for (int slot = 0; slot < FAT_SECTOR_CACHE_SIZE; ++slot)
+		fat_dirty |= fat_sector_dirty[slot];
+}
+
+// Halt predicate, every asynchronous FAT and cluster write back is done
+static bool is_write_back_done(void *closure) {
+	(void)closure;
+	return fat_writing_count == 0 && cache_is_written(NULL);
+}
+
+// Halt predicate, entry can be claimed. Once nothing is written, failed entry is retried by polling
+static bool is_cache_claimable(void *closure) {
+	(void)closure;
+	return cache_has_clean_entry(NULL) || cache_is_written(NULL);
+}
+
+/**
+ * Write FAT and dirty clusters after directory change. Syscall only queue them,
+ * any other caller wait until they are on disk
+ */
+static void flush_directory_change() {
+	if (vfs_may_block) {
+		flush_fat_async();
+		cache_write_back_async();
+		return;
+	}
+	flush_fat();
+	cache_sync();
+}
+
+/* Free cluster bitmap, mirror of empty FAT entries below cluster_count */
+#define FREE_MAP_WORD_COUNT (FAT_MAX_PAGE_COUNT * CLUSTER_MAP_SIZE / 32)
+static uint32_t free_map[FREE_MAP_WORD_COUNT];
+static uint32_t free_hint = 0; // Next-fit, word index where last allocation happened
+
+// Scan FAT pages one cluster at a time, the FAT itself is never kept whole in memory
+static void build_free_map() {
+	memset(free_map, 0x00, sizeof(free_map));
+	uint32_t *page = (uint32_t *)fat32_driver_state.cluster_buf.buf;
+	for (uint32_t i = 0; i < fat32_driver_state.fat_page_count; ++i) {
+		read_blocks(page, cluster_to_lba(fat32_driver_state.fat_page_cluster[i]), CLUSTER_BLOCK_COUNT);
+		for (uint32_t j = 0; j < CLUSTER_MAP_SIZE; ++j) {
+			uint32_t cluster = i * CLUSTER_MAP_SIZE + j;
+			if (cluster < fat32_driver_state.cluster_count && page[j] == FAT32_FAT_EMPTY_ENTRY)
+				free_map[cluster / 32] |= 1u << (cluster % 32);
+		}
+	}
+	free_hint = 0;
+}
+
+static void release_cluster(uint32_t cluster) {
+	if (cluster >= fat32_driver_state.cluster_count)
+		return;
+	set_fat_entry(cluster, FAT32_FAT_EMPTY_ENTRY);
+	free_map[cluster / 32] |= 1u << (cluster % 32);
+}
+
+/**
+ * Take a free cluster and mark it as end of chain in FAT,
+ * preferred cluster is used when free so chain stay contiguous
+ *
+ * @param preferred Wanted cluster number, FAT32_FAT_END_OF_FILE if none
+ * @return Allocated cluster, FAT32_FAT_END_OF_FILE when storage is full
+ */
+static uint32_t allocate_cluster(uint32_t preferred) {
+	uint32_t cluster = FAT32_FAT_END_OF_FILE;
+	if (preferred < fat32_driver_state.cluster_count && (free_map[preferred / 32] & (1u << (preferred % 32))))
+		cluster = preferred;
+
+	uint32_t word_count = (fat32_driver_state.cluster_count + 31) / 32;
+	for (uint32_t i = 0; i < word_count && cluster == FAT32_FAT_END_OF_FILE; ++i) {
+		uint32_t word = (free_hint + i) % word_count;
+		if (free_map[word] == 0) continue;
+		cluster = word * 32 + __builtin_ctz(free_map[word]);
+	}
+
+	if (cluster == FAT32_FAT_END_OF_FILE)
+		return FAT32_FAT_END_OF_FILE;
+
+	free_map[cluster / 32] &= ~(1u << (cluster % 32));
+	free_hint = cluster / 32;
+	set_fat_entry(cluster, FAT32_FAT_END_OF_FILE);
+	return cluster;
+}
+
 uint32_t cluster_to_lba(uint32_t cluster) {
 	return cluster * CLUSTER_BLOCK_COUNT;
 };
 
-void write_clusters(const void *ptr, uint32_t cluster_number, uint8_t cluster_count) {
-	write_blocks(ptr, cluster_to_lba(cluster_number), cluster_count * CLUSTER_BLOCK_COUNT);
+void write_clusters(const void *ptr, uint32_t cluster_number, uint32_t cluster_count) {
+	for (uint32_t i = 0; i < cluster_count; ++i)
+		cache_write_cluster((uint8_t *)ptr + i * CLUSTER_SIZE, cluster_number + i);
 }
 
-void read_clusters(void *ptr, uint32_t cluster_number, uint8_t cluster_count) {
-	read_blocks(ptr, cluster_to_lba(cluster_number), cluster_count * CLUSTER_BLOCK_COUNT);
+void read_clusters(void *ptr, uint32_t cluster_number, uint32_t cluster_count) {
+	for (uint32_t i = 0; i < cluster_count; ++i)
+		cache_read_cluster((uint8_t *)ptr + i * CLUSTER_SIZE, cluster_number + i);
 };
 
 static void create_empty_directory_table(struct FAT32DirectoryTable *dir_table, uint32_t current, uint32_t parent) {
@@ -60,13 +282,14 @@ void create_fat32() {
 		file_table.cluster_map[i] = FAT32_FAT_EMPTY_ENTRY;
 	}
 	file_table.cluster_map[0] = CLUSTER_0_VALUE;
-	file_table.cluster_map[1] = CLUSTER_0_VALUE;
+	file_table.cluster_map[1] = FAT32_FAT_END_OF_FILE; // No other FAT page yet
 	file_table.cluster_map[2] = FAT32_FAT_END_OF_FILE;
-	write_clusters(&file_table, FAT_CLUSTER_NUMBER, 1);
+	write_blocks(&file_table, cluster_to_lba(FAT_CLUSTER_NUMBER), CLUSTER_BLOCK_COUNT);
 
 	struct FAT32DirectoryTable dir_table;
 	create_empty_directory_table(&dir_table, ROOT_CLUSTER_NUMBER, ROOT_CLUSTER_NUMBER);
 	write_clusters(&dir_table, ROOT_CLUSTER_NUMBER, 1);
+	cache_sync();
 }
 
 bool is_empty_storage() {
@@ -79,10 +302,72 @@ bool is_empty_storage() {
 	return false;
 }
 
+static uint32_t min(uint32_t a, uint32_t b) {
+	return a < b ? a : b;
+}
+
+/*
+ * Follow FAT page chain starting from FAT entry of cluster 1. A page is either
+ * the first cluster it covers itself, or a cluster covered by earlier pages
+ */
+static void load_fat_pages(uint32_t disk_cluster_count) {
+	fat32_driver_state.fat_page_cluster[0] = FAT_CLUSTER_NUMBER;
+	fat32_driver_state.fat_page_count = 1;
+	fat32_driver_state.cluster_count = min(CLUSTER_MAP_SIZE, disk_cluster_count);
+	reset_fat_sector_cache();
+
+	// Older image keep CLUSTER_0_VALUE / CLUSTER_1_VALUE on entry 1, single page FAT
+	uint32_t next_page = get_fat_entry(FAT_CLUSTER_NUMBER);
+	while (
+			next_page > ROOT_CLUSTER_NUMBER && next_page < disk_cluster_count &&
+			next_page <= fat32_driver_state.fat_page_count * CLUSTER_MAP_SIZE &&
+			fat32_driver_state.fat_page_count < FAT_MAX_PAGE_COUNT
+	) {
+		fat32_driver_state.fat_page_cluster[fat32_driver_state.fat_page_count++] = next_page;
+		fat32_driver_state.cluster_count = min(fat32_driver_state.fat_page_count * CLUSTER_MAP_SIZE, disk_cluster_count);
+		next_page = get_fat_entry(next_page);
+	}
+}
+
+/**
+ * Append FAT pages until FAT cover the whole disk. New page is stored in the first
+ * cluster it covers, so growing never need a free cluster of the covered range.
+ * Entries past the disk end are marked as bad cluster so they are never allocated
+ */
+static void grow_fat_pages(uint32_t disk_cluster_count) {
+	uint32_t *page = (uint32_t *)fat32_driver_state.cluster_buf.buf;
+	while (
+			fat32_driver_state.fat_page_count * CLUSTER_MAP_SIZE < disk_cluster_count &&
+			fat32_driver_state.fat_page_count < FAT_MAX_PAGE_COUNT
+	) {
+		uint32_t tail = fat32_driver_state.fat_page_cluster[fat32_driver_state.fat_page_count - 1];
+		uint32_t new_page = fat32_driver_state.fat_page_count * CLUSTER_MAP_SIZE;
+
+		for (uint32_t i = 0; i < CLUSTER_MAP_SIZE; ++i)
+			page[i] = new_page + i < disk_cluster_count ? FAT32_FAT_EMPTY_ENTRY : FAT32_FAT_BAD_CLUSTER;
+		page[0] = FAT32_FAT_END_OF_FILE; // Page itself, new end of FAT page chain
+		write_blocks(page, cluster_to_lba(new_page), CLUSTER_BLOCK_COUNT);
+		set_fat_entry(tail, new_page);
+
+		fat32_driver_state.fat_page_cluster[fat32_driver_state.fat_page_count++] = new_page;
+		fat32_driver_state.cluster_count = min(fat32_driver_state.fat_page_count * CLUSTER_MAP_SIZE, disk_cluster_count);
+		for (uint32_t cluster = new_page + 1; cluster < fat32_driver_state.cluster_count; ++cluster)
+			free_map[cluster / 32] |= 1u << (cluster % 32);
+	}
+	flush_fat();
+}
+
 void initialize_filesystem_fat32() {
 	if (is_empty_storage())
 		create_fat32();
-	read_clusters(&fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
+
+	uint32_t disk_cluster_count = get_disk_block_count() / CLUSTER_BLOCK_COUNT;
+	if (disk_cluster_count == 0) // Unknown geometry, trust the FAT
+		disk_cluster_count = FAT_MAX_PAGE_COUNT * CLUSTER_MAP_SIZE;
+
+	load_fat_pages(disk_cluster_count);
+	build_free_map();
+	grow_fat_pages(disk_cluster_count);
 }
 
 /* VFS Implementation */
@@ -97,9 +382,184 @@ static void extract_83_fullname(struct FAT32DirectoryEntry *entry, char *result)
 	}
 }
 
+/*
+ * Hashed directory, linear hashing over the directory cluster chain.
+ * Bucket i is the i-th cluster of the chain, every bucket starts with
+ * "." and "..", so a single cluster directory is a valid one bucket directory
+ */
+static uint32_t hash_name(char *name) {
+	uint32_t hash = 2166136261u;
+	for (int i = 0; name[i] != '\0'; ++i) {
+		hash ^= (uint8_t)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*
+ * Bucket cluster of recently used directories, so bucket is indexed without walking
+ * the directory chain. Map is filled with one walk and kept in sync by split_directory
+ */
+struct BucketMap {
+	uint32_t directory_cluster; // 0 when slot is unused
+	uint32_t bucket_count;
+	uint32_t last_used;
+	uint32_t bucket_cluster[FAT32_BUCKET_MAX];
+};
+
+static struct BucketMap bucket_maps[FAT32_BUCKET_MAP_COUNT];
+static uint32_t bucket_map_clock = 0;
+
+static struct BucketMap *get_bucket_map(uint32_t directory_cluster) {
+	struct BucketMap *victim = &bucket_maps[0];
+	for (int i = 0; i < FAT32_BUCKET_MAP_COUNT; ++i) {
+		struct BucketMap *map = &bucket_maps[i];
+		if (map->directory_cluster == directory_cluster) {
+			map->last_used = ++bucket_map_clock;
+			return map;
+		}
+		if (map->directory_cluster == 0 || (victim->directory_cluster != 0 && map->last_used < victim->last_used))
+			victim = map;
+	}
+
+	victim->directory_cluster = directory_cluster;
+	victim->last_used = ++bucket_map_clock;
+	victim->bucket_count = 0;
+	uint32_t cluster = directory_cluster;
+	while (cluster != FAT32_FAT_END_OF_FILE && victim->bucket_count < FAT32_BUCKET_MAX) {
+		victim->bucket_cluster[victim->bucket_count++] = cluster;
+		cluster = get_fat_entry(cluster);
+	}
+	return victim;
+}
+
+static void bucket_map_invalidate(uint32_t directory_cluster) {
+	for (int i = 0; i < FAT32_BUCKET_MAP_COUNT; ++i)
+		if (bucket_maps[i].directory_cluster == directory_cluster)
+			bucket_maps[i].directory_cluster = 0;
+}
+
+// Largest power of two not above bucket_count, buckets below level - bucket_count are already split
+static uint32_t get_bucket_level(uint32_t bucket_count) {
+	uint32_t level = 1;
+	while (level * 2 <= bucket_count)
+		level *= 2;
+	return level;
+}
+
+static uint32_t get_bucket_cluster(uint32_t directory_cluster, char *name) {
+	struct BucketMap *map = get_bucket_map(directory_cluster);
+	uint32_t level = get_bucket_level(map->bucket_count);
+	uint32_t hash = hash_name(name);
+
+	uint32_t bucket = hash & (level - 1);
+	if (bucket < map->bucket_count - level)
+		bucket = hash & (level * 2 - 1);
+	return map->bucket_cluster[bucket];
+}
+
+/**
+ * Resolve name inside directory, through dentry cache and name bucket
+ *
+ * @param directory_cluster First cluster of directory
+ * @param name              8.3 fullname to search
+ * @param result            Location of found entry
+ * @return True when name exist
+ */
+static bool lookup_directory(uint32_t directory_cluster, char *name, struct DentryCacheEntry *result) {
+	if (dentry_lookup(directory_cluster, name, result))
+		return !result->negative;
+
+	struct FAT32DirectoryTable dir;
+	uint32_t table_cluster = get_bucket_cluster(directory_cluster, name);
+	read_clusters(&dir, table_cluster, 1);
+
+	for (int i = RESERVED_ENTRY; i < MAX_DIR_TABLE_ENTRY; ++i) {
+		struct FAT32DirectoryEntry *current_entry = &dir.table[i];
+		if (current_entry->user_attribute != UATTR_NOT_EMPTY)
+			continue;
+
+		char current_name[MAX_83_FILENAME_SIZE];
+		extract_83_fullname(current_entry, current_name);
+		if (strcmp(current_name, name) == 0) {
+			result->negative = false;
+			result->table_cluster = table_cluster;
+			result->directory_index = i;
+			result->cluster = get_cluster_from_dir_entry(current_entry);
+			result->attribute = current_entry->attribute;
+			dentry_insert(directory_cluster, name, table_cluster, i, result->cluster, result->attribute);
+			return true;
+		}
+	}
+
+	dentry_insert_negative(directory_cluster, name);
+	return false;
+}
+
+/**
+ * Add one bucket to directory by splitting the next bucket in linear hashing order.
+ * FAT change is left dirty for caller to flush
+ *
+ * @param directory_cluster First cluster of directory
+ * @return False when storage is full or directory has FAT32_BUCKET_MAX buckets
+ */
+static bool split_directory(uint32_t directory_cluster) {
+	struct BucketMap *map = get_bucket_map(directory_cluster);
+	uint32_t bucket_count = map->bucket_count;
+	if (bucket_count >= FAT32_BUCKET_MAX)
+		return false;
+
+	uint32_t tail = map->bucket_cluster[bucket_count - 1];
+	uint32_t new_cluster = allocate_cluster(tail + 1);
+	if (new_cluster == FAT32_FAT_END_OF_FILE)
+		return false;
+	set_fat_entry(tail, new_cluster);
+	map->bucket_cluster[map->bucket_count++] = new_cluster;
+
+	uint32_t level = get_bucket_level(bucket_count);
+	uint32_t split_cluster = map->bucket_cluster[bucket_count - level];
+
+	struct FAT32DirectoryTable old_table;
+	struct FAT32DirectoryTable new_table;
+	read_clusters(&old_table, split_cluster, 1);
+	memset(&new_table, 0x00, CLUSTER_SIZE);
+	memcpy(&new_table.table[0], &old_table.table[0], RESERVED_ENTRY * sizeof(struct FAT32DirectoryEntry));
+
+	// Entries with next hash bit set belong to the new bucket
+	int moved = RESERVED_ENTRY;
+	for (int i = RESERVED_ENTRY; i < MAX_DIR_TABLE_ENTRY; ++i) {
+		struct FAT32DirectoryEntry *current_entry = &old_table.table[i];
+		if (current_entry->user_attribute != UATTR_NOT_EMPTY)
+			continue;
+
+		char name[MAX_83_FILENAME_SIZE];
+		extract_83_fullname(current_entry, name);
+		if ((hash_name(name) & (level * 2 - 1)) != bucket_count)
+			continue;
+
+		memcpy(&new_table.table[moved++], current_entry, sizeof(struct FAT32DirectoryEntry));
+		memset(current_entry, 0x00, sizeof(struct FAT32DirectoryEntry));
+	}
+
+	write_clusters(&old_table, split_cluster, 1);
+	write_clusters(&new_table, new_cluster, 1);
+	dentry_invalidate_directory(directory_cluster);
+	return true;
+}
+
 // Really botching here
 #define MAX_PATH 1024
-int get_entry_with_parent_cluster_and_index(char *path, struct FAT32DirectoryEntry *entry, uint32_t *parent_cluster, uint32_t *index) {
+
+/**
+ * Resolve path into directory entry and its location
+ *
+ * @param path              Absolute path
+ * @param entry             Copy of found entry
+ * @param directory_cluster First cluster of directory containing the entry
+ * @param table_cluster     Bucket cluster holding the entry
+ * @param index             Index of entry inside bucket cluster
+ */
+int get_entry_with_location(char *path, struct FAT32DirectoryEntry *entry, uint32_t *directory_cluster, uint32_t *table_cluster, uint32_t *index) {
 	int size = str_len(path) + 1;
 	char copy[size];
 	strcpy(copy, path, size);
@@ -107,48 +567,39 @@ int get_entry_with_parent_cluster_and_index(char *path, struct FAT32DirectoryEnt
 	char *current = strtok(copy, '/');
 
 	struct FAT32DirectoryTable dir;
-	read_clusters(&dir, ROOT_CLUSTER_NUMBER, 1);
 	if (current == NULL) {
-		*parent_cluster = ROOT_CLUSTER_NUMBER;
+		read_clusters(&dir, ROOT_CLUSTER_NUMBER, 1);
+		*directory_cluster = ROOT_CLUSTER_NUMBER;
+		*table_cluster = ROOT_CLUSTER_NUMBER;
+		*index = 0;
 		memcpy(entry, &dir.table[0], sizeof(struct FAT32DirectoryEntry));
 		return 0;
 	}
 
-	struct FAT32DirectoryEntry *current_entry = NULL;
+	// Walk the path with dentry cache, bucket only scanned on cache miss
+	uint32_t current_directory = ROOT_CLUSTER_NUMBER;
+	struct DentryCacheEntry dentry;
 	while (true) {
-		*parent_cluster = get_cluster_from_dir_entry(&dir.table[0]);
-
-		bool found = false;
-		for (int i = RESERVED_ENTRY; i < MAX_DIR_TABLE_ENTRY; ++i) {
-			current_entry = &dir.table[i];
-			if (current_entry->user_attribute != UATTR_NOT_EMPTY)
-				continue;
-
-			char name[MAX_83_FILENAME_SIZE];
-			extract_83_fullname(current_entry, name);
-			if (strcmp(name, current) == 0) {
-				*index = i;
-				found = true;
-				break;
-			}
-		}
-
-		if (!found)
+		*directory_cluster = current_directory;
+		if (!lookup_directory(current_directory, current, &dentry))
 			return -1;
 
 		current = strtok(NULL, '/');
 		if (current == NULL) break;
-		if (current_entry->attribute != ATTR_SUBDIRECTORY) return -1;
-		read_clusters(&dir, get_cluster_from_dir_entry(current_entry), 1);
+		if (dentry.attribute != ATTR_SUBDIRECTORY) return -1;
+		current_directory = dentry.cluster;
 	}
 
-	memcpy(entry, current_entry, sizeof(struct FAT32DirectoryEntry));
+	*table_cluster = dentry.table_cluster;
+	*index = dentry.directory_index;
+	read_clusters(&dir, *table_cluster, 1);
+	memcpy(entry, &dir.table[*index], sizeof(struct FAT32DirectoryEntry));
 	return 0;
 }
 
 static int get_entry(char *path, struct FAT32DirectoryEntry *entry) {
-	uint32_t tmp1, tmp2;
-	return get_entry_with_parent_cluster_and_index(path, entry, &tmp1, &tmp2);
+	uint32_t tmp1, tmp2, tmp3;
+	return get_entry_with_location(path, entry, &tmp1, &tmp2, &tmp3);
 }
 
 static int get_entry_count(struct FAT32DirectoryEntry *entry) {
@@ -157,11 +608,15 @@ static int get_entry_count(struct FAT32DirectoryEntry *entry) {
 
 	int count = 0;
 	struct FAT32DirectoryTable dir;
-	read_clusters(&dir, get_cluster_from_dir_entry(entry), 1);
-	for (int i = RESERVED_ENTRY; i < MAX_DIR_TABLE_ENTRY; ++i) {
-		struct FAT32DirectoryEntry *current_entry = &dir.table[i];
-		if (current_entry->user_attribute == UATTR_NOT_EMPTY)
-			count += 1;
+	uint32_t current_cluster = get_cluster_from_dir_entry(entry);
+	while (current_cluster != FAT32_FAT_END_OF_FILE) {
+		read_clusters(&dir, current_cluster, 1);
+		for (int i = RESERVED_ENTRY; i < MAX_DIR_TABLE_ENTRY; ++i) {
+			struct FAT32DirectoryEntry *current_entry = &dir.table[i];
+			if (current_entry->user_attribute == UATTR_NOT_EMPTY)
+				count += 1;
+		}
+		current_cluster = get_fat_entry(current_cluster);
 	}
 	return count;
 }
@@ -172,6 +627,7 @@ static void fat32_to_vfs(struct FAT32DirectoryEntry *fat32, struct VFSEntry *vfs
 	extract_83_fullname(fat32, vfs->name);
 	vfs->type = aFile ? File : Directory;
 	vfs->size = fat32->filesize;
+	vfs->location = get_cluster_from_dir_entry(fat32);
 	if (!aFile)
 		vfs->size = get_entry_count(fat32);
 }
@@ -193,59 +649,104 @@ static int dirstat(char *path, struct VFSEntry *entries) {
 		return status;
 
 	struct FAT32DirectoryTable dir;
-	read_clusters(&dir, get_cluster_from_dir_entry(&fat32_entry), 1);
+	uint32_t current_cluster = get_cluster_from_dir_entry(&fat32_entry);
 
 	int count = 0;
-	for (int i = RESERVED_ENTRY; i < MAX_DIR_TABLE_ENTRY; ++i) {
-		struct FAT32DirectoryEntry *current_entry = &dir.table[i];
-		if (current_entry->user_attribute != UATTR_NOT_EMPTY)
-			continue;
+	while (current_cluster != FAT32_FAT_END_OF_FILE) {
+		read_clusters(&dir, current_cluster, 1);
+		for (int i = RESERVED_ENTRY; i < MAX_DIR_TABLE_ENTRY; ++i) {
+			struct FAT32DirectoryEntry *current_entry = &dir.table[i];
+			if (current_entry->user_attribute != UATTR_NOT_EMPTY)
+				continue;
 
-		fat32_to_vfs(current_entry, &entries[count++]);
+			fat32_to_vfs(current_entry, &entries[count++]);
+		}
+		current_cluster = get_fat_entry(current_cluster);
 	}
 
 	return 0;
 };
 
 #define MAX_OPENED_FILE 16
-struct VFSStateOld { // Local struct to track opened file
-	bool used;
-	char buffer[CLUSTER_SIZE];
-	uint32_t progress_pointer;
-	uint32_t progress_end;
-	uint32_t current_cluster;
 
-	// Kinda botching here
-	uint32_t directory_cluster;
-	uint32_t directory_index;
+/**
+ * FAT32Extent, physically consecutive clusters of a file
+ *
+ * @param index   Cluster index inside the file of the first cluster
+ * @param cluster First cluster number
+ * @param length  Cluster count
+ */
+struct FAT32Extent {
+	uint32_t index;
+	uint32_t cluster;
+	uint32_t length;
 };
 
 // Local struct to track opened file
 struct VFSState {
-	char buffer[CLUSTER_SIZE];
+	char buffer[CLUSTER_SIZE]; // Scratch for spans that only cover part of a cluster
 	uint32_t progress_pointer;
 	uint32_t progress_end;
+
+	// Cluster cursor, current_cluster is the current_index-th cluster of the file
+	uint32_t first_cluster;
 	uint32_t current_cluster;
+	uint32_t current_index;
+
+	// Extent map of the first mapped_count clusters, filled while the chain is walked
+	struct FAT32Extent extents[FAT32_EXTENT_COUNT];
+	uint32_t extent_count;
+	uint32_t mapped_count;
 
-	// Kinda botching here
+	// Entry can move between directory buckets, resolved again by name when flushed
 	uint32_t directory_cluster;
-	uint32_t directory_index;
+	char name[MAX_83_FILENAME_SIZE];
+
+	// progress_end is newer than directory entry, counted in size_dirty_count
+	bool size_dirty;
+
+	// Readahead, read starting at readahead_next cluster index is sequential
+	uint32_t readahead_next;
+	uint32_t readahead_window;
+	uint32_t readahead_end; // Clusters before this index are already queued
+
+	// Parked syscall, cluster it wait for and bytes of restarted write already done
+	uint32_t wait_cluster;
+	uint32_t write_resume;
+
+	struct VFSState *next_open;
 };
 
+// Every opened file, aged filesize is flushed without waiting for its close()
+static struct VFSState *open_state_list = NULL;
+
 static int open(char *path) {
 	struct VFSState *state = kmalloc(sizeof(struct VFSState));
 
 	struct FAT32DirectoryEntry entry;
-	int status = get_entry_with_parent_cluster_and_index(path, &entry, &state->directory_cluster, &state->directory_index);
-	if (status != 0)
-		return status;
-
-	if (entry.attribute == ATTR_SUBDIRECTORY)
+	uint32_t table_cluster, index;
+	int status = get_entry_with_location(path, &entry, &state->directory_cluster, &table_cluster, &index);
+	if (status != 0 || entry.attribute == ATTR_SUBDIRECTORY) {
+		kfree(state);
 		return -1;
-
-	state->current_cluster = get_cluster_from_dir_entry(&entry);
+	}
+	extract_83_fullname(&entry, state->name);
+
+	state->first_cluster = get_cluster_from_dir_entry(&entry);
+	state->current_cluster = state->first_cluster;
+	state->current_index = 0;
+	state->extents[0].index = 0;
+	state->extents[0].cluster = state->first_cluster;
+	state->extents[0].length = 1;
+	state->extent_count = 1;
+	state->mapped_count = 1;
 	state->progress_pointer = 0;
 	state->progress_end = entry.filesize;
+	state->size_dirty = false;
+	state->readahead_next = 0;
+	state->readahead_window = 0;
+	state->readahead_end = 0;
+	state->write_resume = 0;
 
 	status = register_file_table_context((void *)state);
 	if (status < 0) {
@@ -253,95 +754,449 @@ static int open(char *path) {
 		return status;
 	}
 
+	state->next_open = open_state_list;
+	open_state_list = state;
 	return status;
 };
 
+// Deferred filesize into directory entry, through cluster cache
+static void write_size(struct VFSState *state) {
+	if (!state->size_dirty)
+		return;
+
+	// File may be deleted while still opened, do not touch recreated entry
+	struct DentryCacheEntry dentry;
+	if (lookup_directory(state->directory_cluster, state->name, &dentry) && dentry.cluster == state->first_cluster) {
+		struct FAT32DirectoryTable dir;
+		read_clusters(&dir, dentry.table_cluster, 1);
+		dir.table[dentry.directory_index].filesize = state->progress_end;
+		write_clusters(&dir, dentry.table_cluster, 1);
+	}
+	state->size_dirty = false;
+	size_dirty_count -= 1;
+}
+
+// Write deferred filesize and FAT into disk, then every dirty cached cluster
+static void flush_state(struct VFSState *state) {
+	if (fat_dirty)
+		flush_fat();
+	write_size(state);
+	cache_sync();
+}
+
+/**
+ * Park syscall until cluster can be used from cache without touching the disk
+ *
+ * @param cluster_pointer Cluster to wait for, inside VFSState so it outlive the syscall
+ * @param need_content    Old content is read, false when cluster is overwritten whole
+ * @return True if cluster can be used now, false if caller is parked and must return
+ */
+static bool wait_cluster_cached(uint32_t *cluster_pointer, bool need_content) {
+	if (cache_is_ready(*cluster_pointer))
+		return true;
+
+	if (!cache_is_loaded(cluster_pointer)) { // Already queued by readahead
+		scheduler_halt_current_process(cache_is_loaded, cluster_pointer, true);
+		return false;
+	}
+
+	// Clean entry is needed, otherwise claiming one write a dirty one back by polling
+	if (!cache_has_clean_entry(NULL)) {
+		cache_write_back_async();
+		if (!is_cache_claimable(NULL)) {
+			scheduler_halt_current_process(is_cache_claimable, NULL, true);
+			return false;
+		}
+	}
+
+	if (need_content && cache_prefetch_async(*cluster_pointer, 1)) {
+		scheduler_halt_current_process(cache_is_loaded, cluster_pointer, true);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Syscall flush, queue filesize, FAT and dirty clusters then park until they are written.
+ * Restarted syscall call it again and only find what was dirtied meanwhile
+ *
+ * @return True once everything is written, false if caller is parked and must return
+ */
+static bool flush_state_async(struct VFSState *state) {
+	// Filesize goes into its directory cluster, bring it in by interrupt first
+	struct DentryCacheEntry dentry;
+	if (state->size_dirty && lookup_directory(state->directory_cluster, state->name, &dentry)) {
+		state->wait_cluster = dentry.table_cluster;
+		if (!wait_cluster_cached(&state->wait_cluster, true))
+			return false;
+	}
+
+	write_size(state);
+	flush_fat_async();
+	cache_write_back_async();
+	if (is_write_back_done(NULL)) {
+		flush_state(state); // Only write that failed is left, retried by polling
+		return true;
+	}
+
+	scheduler_halt_current_process(is_write_back_done, NULL, true);
+	return false;
+}
+
+// Called outside of any file system operation, nothing is waited for so caller is never held up
+void fat32_flush_expired(void) {
+	if (!is_metadata_dirty() || second_elapsed - metadata_dirty_since < FAT32_MAX_DIRTY_SECOND)
+		return;
+
+	flush_fat_async();
+	for (struct VFSState *state = open_state_list; state != NULL; state = state->next_open) {
+		// Filesize waiting for its directory cluster is written on a later flush
+		struct DentryCacheEntry dentry;
+		if (
+				state->size_dirty && lookup_directory(state->directory_cluster, state->name, &dentry) &&
+				!cache_is_ready(dentry.table_cluster)
+		) {
+			if (cache_has_clean_entry(NULL))
+				cache_prefetch_async(dentry.table_cluster, 1);
+			continue;
+		}
+		write_size(state);
+	}
+	cache_write_back_async();
+}
+
 static int close(int ft) {
-	struct VFSFileTableEntry *entry = get_file_table_context(ft);
+	struct VFSState *state = (void *)get_file_table_context(ft);
+	if (vfs_may_block) {
+		if (!flush_state_async(state))
+			return 0;
+	} else {
+		flush_state(state);
+	}
+
+	struct VFSState **link = &open_state_list;
+	while (*link != state)
+		link = &(*link)->next_open;
+	*link = state->next_open;
+
 	unregister_file_table_context(ft);
-	kfree(entry);
+	kfree(state);
 	return 0;
 };
 
+static int fsync(int ft) {
+	struct VFSState *state = (void *)get_file_table_context(ft);
+	if (vfs_may_block)
+		flush_state_async(state);
+	else
+		flush_state(state);
+	return 0;
+}
+
+// Extend chain after tail, return FAT32_FAT_END_OF_FILE when storage is full
+static uint32_t allocate_cluster_after(uint32_t tail) {
+	uint32_t free_cluster = allocate_cluster(tail + 1);
+	if (free_cluster == FAT32_FAT_END_OF_FILE)
+		return FAT32_FAT_END_OF_FILE;
+
+	set_fat_entry(tail, free_cluster);
+	return free_cluster;
+}
+
+// Record count consecutive clusters starting at file cluster index, only prefix of the file is kept
+static void map_run(struct VFSState *state, uint32_t index, uint32_t cluster, uint32_t count) {
+	while (index + count > state->mapped_count && index <= state->mapped_count) {
+		uint32_t next_cluster = cluster + (state->mapped_count - index);
+		struct FAT32Extent *last = &state->extents[state->extent_count - 1];
+		if (last->cluster + last->length == next_cluster) {
+			last->length += 1;
+		} else if (state->extent_count < FAT32_EXTENT_COUNT) {
+			struct FAT32Extent *extent = &state->extents[state->extent_count++];
+			extent->index = state->mapped_count;
+			extent->cluster = next_cluster;
+			extent->length = 1;
+		} else {
+			return; // Map is full, rest of the file is reached by walking the chain
+		}
+		state->mapped_count += 1;
+	}
+}
+
+// Find cluster of mapped file cluster index
+static uint32_t get_mapped_cluster(struct VFSState *state, uint32_t index) {
+	uint32_t low = 0;
+	uint32_t high = state->extent_count - 1;
+	while (low < high) {
+		uint32_t mid = (low + high + 1) / 2;
+		if (state->extents[mid].index <= index)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return state->extents[low].cluster + (index - state->extents[low].index);
+}
+
+// Move cursor one cluster forward, extending the chain when allocate is set
+static bool advance_cluster(struct VFSState *state, bool allocate) {
+	uint32_t next_cluster = get_fat_entry(state->current_cluster);
+	if (next_cluster == FAT32_FAT_END_OF_FILE) {
+		if (!allocate)
+			return false;
+		next_cluster = allocate_cluster_after(state->current_cluster);
+		if (next_cluster == FAT32_FAT_END_OF_FILE)
+			return false;
+	}
+
+	state->current_cluster = next_cluster;
+	state->current_index += 1;
+	map_run(state, state->current_index, next_cluster, 1);
+	return true;
+}
+
+// Move cursor to the index-th cluster of the file, mapped part never walk the chain
+static bool seek_cluster(struct VFSState *state, uint32_t index, bool allocate) {
+	uint32_t nearest = min(index, state->mapped_count - 1);
+	if (index < state->current_index || state->current_index < nearest) {
+		state->current_cluster = get_mapped_cluster(state, nearest);
+		state->current_index = nearest;
+	}
+
+	while (state->current_index < index) {
+		if (!advance_cluster(state, allocate))
+			return false;
+	}
+	return true;
+}
+
+// Count physically consecutive clusters of a chain, starting from cluster
+static uint32_t get_contiguous_run(uint32_t cluster, uint32_t max_count) {
+	uint32_t run = 1;
+	while (run < max_count && get_fat_entry(cluster + run - 1) == cluster + run)
+		run += 1;
+	return run;
+}
+
+/**
+ * Grow readahead window on sequential read, drop it on random access, then queue
+ * the clusters of window that follow the read position into the cluster cache
+ *
+ * @param start_index Cluster index where the finished read started
+ */
+static void readahead(struct VFSState *state, uint32_t start_index) {
+	if (start_index == state->readahead_next)
+		state->readahead_window = state->readahead_window == 0 ? FAT32_READAHEAD_MIN : min(state->readahead_window * 2, FAT32_READAHEAD_MAX);
+	else
+		state->readahead_window = 0;
+
+	uint32_t next = state->progress_pointer / CLUSTER_SIZE;
+	state->readahead_next = next;
+	if (state->readahead_window == 0 || state->progress_pointer >= state->progress_end) {
+		state->readahead_end = 0;
+		return;
+	}
+
+	// Queue again only once reader consumed half of what is ahead
+	uint32_t index = state->readahead_end > next ? state->readahead_end : next;
+	if (index - next > state->readahead_window / 2)
+		return;
+
+	uint32_t end = min(next + state->readahead_window, (state->progress_end - 1) / CLUSTER_SIZE + 1);
+	uint32_t saved_cluster = state->current_cluster;
+	uint32_t saved_index = state->current_index;
+	while (index < end && seek_cluster(state, index, false)) {
+		uint32_t run = get_contiguous_run(state->current_cluster, end - index);
+		cache_prefetch_async(state->current_cluster, run);
+		index += run;
+	}
+	state->current_cluster = saved_cluster;
+	state->current_index = saved_index;
+	state->readahead_end = index;
+}
+
 static int read_vfs(int ft, char *buffer, int size) {
 	struct VFSState *state = (void *)get_file_table_context(ft);
+	uint32_t start_index = state->progress_pointer / CLUSTER_SIZE;
 
-	int read_count = 0;
-	while (true) {
-		if (read_count >= size) break;
-		if (state->progress_pointer >= state->progress_end) break;
+	uint32_t read_count = 0;
+	while (read_count < (uint32_t)size && state->progress_pointer < state->progress_end) {
+		uint32_t local_offset = state->progress_pointer % CLUSTER_SIZE;
+		uint32_t remaining = min(size - read_count, state->progress_end - state->progress_pointer);
 
-		int local_offset = state->progress_pointer % CLUSTER_SIZE;
-		if (local_offset == 0) {
-			if (state->current_cluster == FAT32_FAT_END_OF_FILE) // Corrupted file
-				return -1;
+		if (!seek_cluster(state, state->progress_pointer / CLUSTER_SIZE, false)) // Corrupted file
+			return -1;
 
-			read_clusters(state->buffer, state->current_cluster, 1);
-			state->current_cluster = fat32_driver_state.fat_table.cluster_map[state->current_cluster];
+		// Called from syscall, let disk fill the cache by interrupt instead of polling it
+		if (vfs_may_block && !cache_is_ready(state->current_cluster)) {
+			uint32_t wanted = (local_offset + remaining + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+			uint32_t run = get_contiguous_run(state->current_cluster, min(wanted, CACHE_ASYNC_MAX_CLUSTER));
+			if (cache_prefetch_async(state->current_cluster, run)) {
+				if (read_count > 0)
+					break;
+
+				// Syscall is restarted once loading is done, cursor is kept in state
+				scheduler_halt_current_process(cache_is_loaded, &state->current_cluster, true);
+				return 0;
+			}
 		}
 
-		buffer[read_count] = state->buffer[local_offset];
-		state->progress_pointer += 1;
-		read_count += 1;
+		// Whole clusters wanted by both caller and file, read them straight into buffer
+		if (local_offset == 0 && remaining >= CLUSTER_SIZE) {
+			uint32_t run = get_contiguous_run(state->current_cluster, min(remaining / CLUSTER_SIZE, CACHE_MAX_RUN_CLUSTER));
+			if (vfs_may_block) { // Only clusters already in memory, the rest goes through prefetch
+				uint32_t ready = 1;
+				while (ready < run && cache_is_ready(state->current_cluster + ready))
+					ready += 1;
+				run = ready;
+			}
+			cache_read_clusters_direct(&buffer[read_count], state->current_cluster, run);
+			map_run(state, state->current_index, state->current_cluster, run);
+
+			state->current_cluster += run - 1;
+			state->current_index += run - 1;
+			state->progress_pointer += run * CLUSTER_SIZE;
+			read_count += run * CLUSTER_SIZE;
+			continue;
+		}
+
+		uint32_t span = min(CLUSTER_SIZE - local_offset, remaining);
+		read_clusters(state->buffer, state->current_cluster, 1);
+		memcpy(&buffer[read_count], &state->buffer[local_offset], span);
+
+		state->progress_pointer += span;
+		read_count += span;
 	}
 
+	if (read_count > 0)
+		readahead(state, start_index);
 	return read_count;
 };
 
 static int write_vfs(int ft, char *buffer, int size) {
 	struct VFSState *state = (void *)get_file_table_context(ft);
+	exec_cache_invalidate(state->first_cluster);
+
+	// Restarted syscall continue after what its parked run already wrote
+	uint32_t write_count = state->write_resume;
+	state->write_resume = 0;
+	bool storage_full = false;
+	bool parked = false;
+	while (write_count < (uint32_t)size) {
+		uint32_t local_offset = state->progress_pointer % CLUSTER_SIZE;
+		uint32_t remaining = size - write_count;
+
+		if (!seek_cluster(state, state->progress_pointer / CLUSTER_SIZE, true)) {
+			storage_full = true;
+			break;
+		}
 
-	int write_count = 0;
-	while (true) {
-		if (write_count >= size) break;
-
-		int local_offset = state->progress_pointer % CLUSTER_SIZE;
-		if (local_offset == 0) {
-			uint32_t old_cluster = state->current_cluster;
-			if (state->progress_pointer != 0) {
-				write_clusters(state->buffer, state->current_cluster, 1);
-				state->current_cluster = fat32_driver_state.fat_table.cluster_map[state->current_cluster];
-			}
+		// Called from syscall, data goes into cache one cluster at a time and written back by interrupt
+		uint32_t span = min(CLUSTER_SIZE - local_offset, remaining);
+		bool fresh = local_offset == 0 && state->progress_pointer >= state->progress_end;
+		if (vfs_may_block && !wait_cluster_cached(&state->current_cluster, span != CLUSTER_SIZE && !fresh)) {
+			state->write_resume = write_count;
+			parked = true;
+			break;
+		}
 
-			if (state->current_cluster == FAT32_FAT_END_OF_FILE) {
-				// Searching free FAT table
-				uint32_t free_cluster = 0;
-				while (free_cluster < CLUSTER_MAP_SIZE) {
-					if (fat32_driver_state.fat_table.cluster_map[free_cluster] == FAT32_FAT_EMPTY_ENTRY) break;
-					free_cluster += 1;
-				}
-
-				if (free_cluster == CLUSTER_MAP_SIZE) // Storage full
-					return -1;
-
-				// Refreshing FAT table
-				fat32_driver_state.fat_table.cluster_map[old_cluster] = free_cluster;
-				fat32_driver_state.fat_table.cluster_map[free_cluster] = FAT32_FAT_END_OF_FILE;
-				write_clusters(fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
-				state->current_cluster = free_cluster;
+		// Whole clusters, extend chain while it stays consecutive and write them straight from buffer
+		if (!vfs_may_block && local_offset == 0 && remaining >= CLUSTER_SIZE) {
+			uint32_t first_cluster = state->current_cluster;
+			uint32_t run = 1;
+			uint32_t max_run = min(remaining / CLUSTER_SIZE, CACHE_MAX_RUN_CLUSTER);
+			while (run < max_run) {
+				if (!advance_cluster(state, true)) break;
+				if (state->current_cluster != first_cluster + run) break; // Cursor already on next run
+				run += 1;
 			}
+			cache_write_clusters_direct(&buffer[write_count], first_cluster, run);
 
-			read_clusters(state->buffer, state->current_cluster, 1);
+			state->progress_pointer += run * CLUSTER_SIZE;
+			write_count += run * CLUSTER_SIZE;
+			continue;
+		}
+
+		if (span == CLUSTER_SIZE) {
+			write_clusters(&buffer[write_count], state->current_cluster, 1);
+		} else {
+			if (fresh)
+				memset(state->buffer, 0x00, CLUSTER_SIZE); // Fresh cluster, nothing to preserve
+			else
+				read_clusters(state->buffer, state->current_cluster, 1);
+			memcpy(&state->buffer[local_offset], &buffer[write_count], span);
+			write_clusters(state->buffer, state->current_cluster, 1);
 		}
 
-		state->buffer[local_offset] = buffer[write_count];
-		state->progress_pointer += 1;
-		write_count += 1;
+		state->progress_pointer += span;
+		write_count += span;
 	}
-	write_clusters(state->buffer, state->current_cluster, 1);
 
-	if (state->progress_pointer > state->progress_end)
+	if (state->progress_pointer > state->progress_end) {
 		state->progress_end = state->progress_pointer;
+		if (!state->size_dirty) {
+			mark_metadata_dirty();
+			state->size_dirty = true;
+			size_dirty_count += 1;
+		}
+	}
 
-	// Refresh directory table
-	struct FAT32DirectoryTable dir;
-	read_clusters(&dir, state->directory_cluster, 1);
-	dir.table[state->directory_index].filesize = state->progress_end;
-	write_clusters(&dir, state->directory_cluster, 1);
-
+	if (parked) // Result is not returned, syscall run again once cluster is cached
+		return 0;
+	if (storage_full && write_count == 0)
+		return -1;
 	return write_count;
 };
 
+static int seek(int ft, int offset, int whence) {
+	struct VFSState *state = (void *)get_file_table_context(ft);
+
+	int base;
+	switch (whence) {
+	case SEEK_SET:
+		base = 0;
+		break;
+	case SEEK_CUR:
+		base = state->progress_pointer;
+		break;
+	case SEEK_END:
+		base = state->progress_end;
+		break;
+	default:
+		return -1;
+	}
+
+	// Hole is not supported, position stay inside the file
+	int position = base + offset;
+	if (position < 0 || (uint32_t)position > state->progress_end)
+		return -1;
+
+	state->progress_pointer = position;
+	return position;
+}
+
+static int pread(int ft, char *buffer, int size, int offset) {
+	struct VFSState *state = (void *)get_file_table_context(ft);
+	if (offset < 0 || (uint32_t)offset > state->progress_end)
+		return -1;
+
+	uint32_t saved_pointer = state->progress_pointer;
+	state->progress_pointer = offset;
+	int result = read_vfs(ft, buffer, size);
+	state->progress_pointer = saved_pointer;
+	return result;
+}
+
+static int pwrite(int ft, char *buffer, int size, int offset) {
+	struct VFSState *state = (void *)get_file_table_context(ft);
+	if (offset < 0 || (uint32_t)offset > state->progress_end)
+		return -1;
+
+	uint32_t saved_pointer = state->progress_pointer;
+	state->progress_pointer = offset + state->write_resume;
+	int result = write_vfs(ft, buffer, size);
+	state->progress_pointer = saved_pointer;
+	return result;
+}
+
 int mkgeneral(char *path, char *name, char *ext, bool aFile) {
 	if (strcmp(path, ".") == 0 || strcmp(path, "..") == 0)
 		return -1;
@@ -351,36 +1206,50 @@ int mkgeneral(char *path, char *name, char *ext, bool aFile) {
 	if (status != 0)
 		return status;
 
-	struct FAT32DirectoryTable dir;
+	if (entry.attribute != ATTR_SUBDIRECTORY)
+		return -1;
 	uint32_t parent_cluster = get_cluster_from_dir_entry(&entry);
-	read_clusters(&dir, parent_cluster, 1);
 
-	bool duplicate = false;
-	struct FAT32DirectoryEntry *empty_entry = NULL;
-
-	char used_name[MAX_83_FILENAME_SIZE];
-	for (int i = RESERVED_ENTRY; i < MAX_DIR_TABLE_ENTRY; ++i) {
-		struct FAT32DirectoryEntry *current_entry = &dir.table[i];
-		if (current_entry->user_attribute == UATTR_NOT_EMPTY) {
-			extract_83_fullname(current_entry, used_name);
-			if (strcmp(name, used_name) == 0) {
-				duplicate = true;
-				break;
-			}
-		} else if (empty_entry == NULL) empty_entry = current_entry;
+	// Compare with fullname, same format as path lookup
+	char full_name[MAX_83_FILENAME_SIZE];
+	strcpy(full_name, name, MAX_83_FILENAME_SIZE);
+	if (aFile && str_len(ext) != 0) {
+		strcat(full_name, ".", MAX_83_FILENAME_SIZE);
+		strcat(full_name, ext, MAX_83_FILENAME_SIZE);
 	}
 
-	if (duplicate || empty_entry == NULL)
+	struct DentryCacheEntry dentry;
+	if (lookup_directory(parent_cluster, full_name, &dentry))
 		return -1;
 
-	uint32_t free_cluster = 0;
-	while (free_cluster < CLUSTER_MAP_SIZE) {
-		if (fat32_driver_state.fat_table.cluster_map[free_cluster] == FAT32_FAT_EMPTY_ENTRY) break;
-		free_cluster += 1;
+	// Only the bucket of the name is searched, grow directory while it is full
+	struct FAT32DirectoryTable dir;
+	struct FAT32DirectoryEntry *empty_entry = NULL;
+	uint32_t empty_index = 0;
+	uint32_t table_cluster = 0;
+	while (empty_entry == NULL) {
+		table_cluster = get_bucket_cluster(parent_cluster, full_name);
+		read_clusters(&dir, table_cluster, 1);
+		for (int i = RESERVED_ENTRY; i < MAX_DIR_TABLE_ENTRY; ++i) {
+			if (dir.table[i].user_attribute != UATTR_NOT_EMPTY) {
+				empty_entry = &dir.table[i];
+				empty_index = i;
+				break;
+			}
+		}
+
+		if (empty_entry == NULL && !split_directory(parent_cluster))
+			break;
 	}
 
-	if (free_cluster == CLUSTER_MAP_SIZE)
+	uint32_t free_cluster = FAT32_FAT_END_OF_FILE;
+	if (empty_entry != NULL)
+		free_cluster = allocate_cluster(FAT32_FAT_END_OF_FILE);
+	if (free_cluster == FAT32_FAT_END_OF_FILE) {
+		// Keep buckets split so far
+		flush_directory_change();
 		return -1;
+	}
 
 	empty_entry->user_attribute = 0x0;
 	empty_entry->filesize = 0;
@@ -391,10 +1260,8 @@ int mkgeneral(char *path, char *name, char *ext, bool aFile) {
 	strcpy(empty_entry->name, name, 8);
 	if (aFile)
 		strcpy(empty_entry->ext, ext, 3);
-	write_clusters(&dir, parent_cluster, 1);
-
-	fat32_driver_state.fat_table.cluster_map[free_cluster] = FAT32_FAT_END_OF_FILE;
-	write_clusters(fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
+	write_clusters(&dir, table_cluster, 1);
+	dentry_insert(parent_cluster, full_name, table_cluster, empty_index, free_cluster, empty_entry->attribute);
 
 	if (!aFile) {
 		struct FAT32DirectoryTable new_dir_table;
@@ -402,6 +1269,7 @@ int mkgeneral(char *path, char *name, char *ext, bool aFile) {
 		write_clusters(&new_dir_table, free_cluster, 1);
 	}
 
+	flush_directory_change();
 	return 0;
 }
 
@@ -468,29 +1336,43 @@ int mkdir(char *path) {
 
 int delete_vfs(char *path) {
 	uint32_t parent_cluster;
+	uint32_t table_cluster;
 	uint32_t index;
 
 	struct FAT32DirectoryEntry entry;
-	int status = get_entry_with_parent_cluster_and_index(path, &entry, &parent_cluster, &index);
+	int status = get_entry_with_location(path, &entry, &parent_cluster, &table_cluster, &index);
 	if (status != 0)
 		return status;
 
+	// Root, "." and ".." are not deletable
+	if (index < RESERVED_ENTRY)
+		return -1;
+
 	if (get_entry_count(&entry) != 0)
 		return -1;
 
 	uint32_t current_cluster = get_cluster_from_dir_entry(&entry);
+	exec_cache_invalidate(current_cluster);
 	while (current_cluster != FAT32_FAT_END_OF_FILE) {
-		int next_cluster = fat32_driver_state.fat_table.cluster_map[current_cluster];
-		fat32_driver_state.fat_table.cluster_map[current_cluster] = FAT32_FAT_EMPTY_ENTRY;
+		int next_cluster = get_fat_entry(current_cluster);
+		release_cluster(current_cluster);
 		current_cluster = next_cluster;
 	}
 
+	char name[MAX_83_FILENAME_SIZE];
+	extract_83_fullname(&entry, name);
+	dentry_invalidate(parent_cluster, name);
+	if (entry.attribute == ATTR_SUBDIRECTORY) {
+		dentry_invalidate_directory(get_cluster_from_dir_entry(&entry));
+		bucket_map_invalidate(get_cluster_from_dir_entry(&entry));
+	}
+
 	struct FAT32DirectoryTable dir;
-	read_clusters(&dir, parent_cluster, 1);
+	read_clusters(&dir, table_cluster, 1);
 	memset(&dir.table[index], 0x00, sizeof(struct FAT32DirectoryEntry));
 
-	write_clusters(&dir, parent_cluster, 1);
-	write_clusters(fat32_driver_state.fat_table.cluster_map, FAT_CLUSTER_NUMBER, 1);
+	write_clusters(&dir, table_cluster, 1);
+	flush_directory_change();
 
 	return 0;
 };
@@ -501,10 +1383,15 @@ struct VFSHandler fat32_vfs = {
 
 		.open = open,
 		.close = close,
+		.fsync = fsync,
 
 		.read = read_vfs,
 		.write = write_vfs,
 
+		.seek = seek,
+		.pread = pread,
+		.pwrite = pwrite,
+
 		.mkfile = mkfile,
 		.mkdir = mkdir,
 
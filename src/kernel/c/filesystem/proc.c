@@ -1,25 +1,132 @@
 #include "filesystem/proc.h"
+#include "driver/block.h"
+#include "driver/disk.h"
 #include "filesystem/vfs.h"
 #include "memory/kmalloc.h"
+#include "process/exec_cache.h"
 #include "process/process.h"
 #include <std/string.h>
 
-static int status;
-static int parse_path(char *path, bool *is_root) {
+struct ProcFileHandler {
+	char name[MAX_VFS_NAME];
+
+	// Fill content with NUL terminated text, at most PROC_CONTENT_SIZE bytes
+	void (*generate)(char *content);
+};
+
+static void append_line(char *content, char *key, uint32_t value) {
+	char number[12];
+	itoa((int)value, number, 10);
+	strcat(content, key, PROC_CONTENT_SIZE);
+	strcat(content, " ", PROC_CONTENT_SIZE);
+	strcat(content, number, PROC_CONTENT_SIZE);
+	strcat(content, "\n", PROC_CONTENT_SIZE);
+}
+
+/* execcache */
+static void execcache_generate(char *content) {
+	append_line(content, "hit", exec_cache_statistic.hit);
+	append_line(content, "miss", exec_cache_statistic.miss);
+	append_line(content, "eviction", exec_cache_statistic.eviction);
+	append_line(content, "invalidation", exec_cache_statistic.invalidation);
+	append_line(content, "used", exec_cache_statistic.used);
+	append_line(content, "budget", EXEC_CACHE_BUDGET);
+}
+
+/* meminfo */
+static void meminfo_generate(char *content) {
+	struct KmallocStatistic statistic;
+	kmalloc_get_statistic(&statistic);
+
+	append_line(content, "heap", statistic.heap_size);
+	append_line(content, "used", statistic.used);
+	append_line(content, "free", statistic.free);
+	append_line(content, "largest_free", statistic.largest_free);
+	append_line(content, "used_block", statistic.used_block);
+	append_line(content, "free_block", statistic.free_block);
+	append_line(content, "allocation", statistic.allocation);
+	append_line(content, "release", statistic.release);
+	append_line(content, "failure", statistic.failure);
+
+	// One line per size class: object size, slab page, allocated object
+	for (int i = 0; i < SLAB_CLASS_COUNT; ++i) {
+		char number[12];
+		itoa(statistic.slab_page[i], number, 10);
+		char key[24] = "slab";
+		itoa(SLAB_MIN_OBJECT << i, key + 4, 10);
+		strcat(key, " ", sizeof(key));
+		strcat(key, number, sizeof(key));
+		append_line(content, key, statistic.slab_object[i]);
+	}
+}
+
+/* disk */
+static void disk_generate(char *content) {
+	append_line(content, "dma_direct", disk_statistic.dma_direct);
+	append_line(content, "dma_bounce", disk_statistic.dma_bounce);
+	append_line(content, "pio", disk_statistic.pio);
+	append_line(content, "queue_submitted", block_statistic.submitted);
+	append_line(content, "queue_dispatched", block_statistic.dispatched);
+	append_line(content, "queue_merged", block_statistic.merged);
+	append_line(content, "benchmark_dma_kib_per_second", disk_statistic.dma_kib_per_second);
+	append_line(content, "benchmark_pio_kib_per_second", disk_statistic.pio_kib_per_second);
+}
+
+#define FILE_COUNT 3
+static struct ProcFileHandler proc_file_handlers[FILE_COUNT] = {
+		{.name = "execcache", .generate = execcache_generate},
+		{.name = "meminfo", .generate = meminfo_generate},
+		{.name = "disk", .generate = disk_generate},
+};
+
+static struct ProcFileHandler *get_file_handler(char *name) {
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		if (strcmp(name, proc_file_handlers[i].name) == 0)
+			return &proc_file_handlers[i];
+	}
+	return NULL;
+}
+
+/**
+ * Split /proc/<name> into name
+ *
+ * @param is_root Set when path is /proc itself
+ * @return        Name under /proc, NULL if path is root or invalid
+ */
+static char *parse_path(char *path, bool *is_root) {
 	*is_root = false;
 	if (strcmp(path, "/proc") == 0) {
 		*is_root = true;
-		return 0;
+		return NULL;
 	}
 
 	strtok(path, '/');
-	char *pid = strtok(NULL, '/');
+	char *name = strtok(NULL, '/');
 	char *trail = strtok(NULL, '/');
 
 	if (trail != NULL)
+		return NULL;
+	return name;
+}
+
+// Either named file or process, content include NUL terminator
+static int generate_content(char *name, char *content) {
+	content[0] = '\0';
+
+	struct ProcFileHandler *handler = get_file_handler(name);
+	if (handler != NULL) {
+		handler->generate(content);
+		return str_len(content) + 1;
+	}
+
+	int pid = strtoi(name, NULL);
+	if (pid < PROCESS_START_PID || pid >= PROCESS_END_PID)
+		return -1;
+	struct ProcessControlBlock *pcb = get_pcb_from_pid(pid);
+	if (pcb == NULL)
 		return -1;
-	int result = strtoi(pid, NULL);
-	return result;
+	strcpy(content, pcb->metadata.name, PROC_CONTENT_SIZE);
+	return str_len(content) + 1;
 }
 
 static int process_stat(struct ProcessControlBlock *pcb, struct VFSEntry *entry) {
@@ -29,10 +136,18 @@ static int process_stat(struct ProcessControlBlock *pcb, struct VFSEntry *entry)
 	itoa(pcb->metadata.pid, entry->name, 10);
 	entry->size = 0;
 	entry->type = File;
+	entry->location = 0;
 
 	return 0;
 }
 
+static void file_stat(int index, struct VFSEntry *entry) {
+	strcpy(entry->name, proc_file_handlers[index].name, MAX_VFS_NAME);
+	entry->size = 0;
+	entry->type = File;
+	entry->location = 0;
+}
+
 static int count_running_process() {
 	int count = 0;
 	for (int pid = PROCESS_START_PID; pid < PROCESS_END_PID; ++pid) {
@@ -49,19 +164,29 @@ static int stat(char *path, struct VFSEntry *entry) {
 	strcpy(copy, path, size);
 
 	bool is_root;
-	int pid = parse_path(copy, &is_root);
-	if (pid < 0)
-		return pid;
+	char *name = parse_path(copy, &is_root);
 
 	if (is_root) {
 		strcpy(entry->name, "proc", 255);
-		entry->size = count_running_process();
+		entry->size = FILE_COUNT + count_running_process();
 		entry->type = Directory;
+		entry->location = 0;
 		return 0;
 	}
+	if (name == NULL)
+		return -1;
+
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		if (strcmp(name, proc_file_handlers[i].name) == 0) {
+			file_stat(i, entry);
+			return 0;
+		}
+	}
 
-	status = process_stat(get_pcb_from_pid(pid), entry);
-	return status;
+	int pid = strtoi(name, NULL);
+	if (pid < PROCESS_START_PID || pid >= PROCESS_END_PID)
+		return -1;
+	return process_stat(get_pcb_from_pid(pid), entry);
 };
 
 static int dirstat(char *path, struct VFSEntry *entries) {
@@ -70,14 +195,13 @@ static int dirstat(char *path, struct VFSEntry *entries) {
 	strcpy(copy, path, size);
 
 	bool is_root;
-	int pid = parse_path(copy, &is_root);
-	if (pid < 0)
-		return pid;
-
+	parse_path(copy, &is_root);
 	if (!is_root)
 		return -1;
 
 	int count = 0;
+	for (int i = 0; i < FILE_COUNT; ++i)
+		file_stat(i, &entries[count++]);
 	for (int pid = PROCESS_START_PID; pid < PROCESS_END_PID; ++pid) {
 		struct ProcessControlBlock *pcb = get_pcb_from_pid(pid);
 		if (pcb == NULL || pcb->metadata.state == Inactive) continue;
@@ -87,10 +211,11 @@ static int dirstat(char *path, struct VFSEntry *entries) {
 	return 0;
 };
 
+// Content is taken once on open, reader see consistent snapshot
 struct VFSState {
-	struct ProcessControlBlock *pcb;
 	int current_pointer;
 	int max_pointer;
+	char content[PROC_CONTENT_SIZE];
 };
 
 static int open(char *path) {
@@ -99,14 +224,20 @@ static int open(char *path) {
 	strcpy(copy, path, size);
 
 	bool is_root;
-	int pid = parse_path(copy, &is_root);
-	if (pid < 0)
-		return pid;
-
-	if (is_root)
+	char *name = parse_path(copy, &is_root);
+	if (name == NULL)
 		return -1;
 
 	struct VFSState *state = kmalloc(sizeof(struct VFSState));
+	if (state == NULL)
+		return -1;
+
+	state->current_pointer = 0;
+	state->max_pointer = generate_content(name, state->content);
+	if (state->max_pointer < 0) {
+		kfree(state);
+		return -1;
+	}
 
 	int ft = register_file_table_context((void *)state);
 	if (ft < 0) {
@@ -114,18 +245,14 @@ static int open(char *path) {
 		return -1;
 	}
 
-	struct ProcessControlBlock *pcb = get_pcb_from_pid(pid);
-
-	state->pcb = pcb;
-	state->current_pointer = 0;
-	state->max_pointer = str_len(pcb->metadata.name) + 1;
-
 	return ft;
 };
 
 static int close(int ft) {
-	(void)ft;
-	return -1;
+	struct VFSState *state = (void *)get_file_table_context(ft);
+	unregister_file_table_context(ft);
+	kfree(state);
+	return 0;
 };
 
 static int read(int ft, char *buffer, int size) {
@@ -138,7 +265,7 @@ static int read(int ft, char *buffer, int size) {
 	while (true) {
 		if (read_count >= size) break;
 		if (state->current_pointer == state->max_pointer) break;
-		buffer[read_count++] = state->pcb->metadata.name[state->current_pointer++];
+		buffer[read_count++] = state->content[state->current_pointer++];
 	}
 
 	return read_count;
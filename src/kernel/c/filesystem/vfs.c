@@ -13,6 +13,8 @@ struct MountPoint {
 };
 static struct MountPoint mount_points[MAX_MOUNT];
 
+bool vfs_may_block = false;
+
 int mount(char *path, struct VFSHandler *handler) {
 	int idx = 0;
 	while (idx < MAX_MOUNT) {
@@ -161,6 +163,7 @@ static int stat(char *path, struct VFSEntry *entry) {
 	if (entry->type == Directory) {
 		for (int i = 0; i < MAX_MOUNT; ++i) {
 			if (
+					mount_points[i].filled &&
 					strcmp(path, mount_points[i].dirname) == 0 &&
 					str_len(mount_points[i].basename) != 0
 			) {
@@ -198,6 +201,7 @@ static int dirstat(char *path, struct VFSEntry *entries) {
 		for (int i = 0; i < MAX_MOUNT; ++i) {
 			struct MountPoint *mp = &mount_points[i];
 			if (
+					mp->filled &&
 					strcmp(path, mp->dirname) == 0 &&
 					str_len(mp->basename) != 0
 			) {
@@ -222,9 +226,22 @@ static int open(char *path) {
 
 static int close(int ft){DIRECT_RUN_HANDLER(close, get_file_table_handler, ft, ft)};
 
+static int fsync(int ft) {
+	struct VFSHandler *handler = get_file_table_handler(ft);
+	if (handler == NULL)
+		return -1;
+	if (handler->fsync == NULL) // Nothing buffered by this handler
+		return 0;
+	return handler->fsync(ft);
+};
+
 static int read(int ft, char *buffer, int size){DIRECT_RUN_HANDLER(read, get_file_table_handler, ft, ft, buffer, size)};
 static int write(int ft, char *buffer, int size){DIRECT_RUN_HANDLER(write, get_file_table_handler, ft, ft, buffer, size)};
 
+static int seek(int ft, int offset, int whence){DIRECT_RUN_HANDLER(seek, get_file_table_handler, ft, ft, offset, whence)};
+static int pread(int ft, char *buffer, int size, int offset){DIRECT_RUN_HANDLER(pread, get_file_table_handler, ft, ft, buffer, size, offset)};
+static int pwrite(int ft, char *buffer, int size, int offset){DIRECT_RUN_HANDLER(pwrite, get_file_table_handler, ft, ft, buffer, size, offset)};
+
 static int mkfile(char *path) { DIRECT_RUN_HANDLER(mkfile, get_handler_by_path, path, path); };
 static int mkdir(char *path) { DIRECT_RUN_HANDLER(mkdir, get_handler_by_path, path, path); };
 
@@ -236,10 +253,15 @@ struct VFSHandler vfs = {
 
 		.open = open,
 		.close = close,
+		.fsync = fsync,
 
 		.read = read,
 		.write = write,
 
+		.seek = seek,
+		.pread = pread,
+		.pwrite = pwrite,
+
 		.mkfile = mkfile,
 		.mkdir = mkdir,
 
@@ -2,6 +2,7 @@
 #include "cpu/gdt.h"
 #include "cpu/idt.h"
 #include "cpu/interrupt.h"
+#include "driver/disk.h"
 #include "driver/time.h"
 #include "filesystem/dev.h"
 #include "filesystem/fat32.h"
@@ -25,8 +26,15 @@ void kernel_setup(void) {
 	pic_remap();
 	initialize_idt();
 	activate_keyboard_interrupt();
+	activate_disk_interrupt();
 
 	/* Filesystem setup */
+	initialize_disk();
+	initialize_disk_dma();
+#ifdef DISK_BENCHMARK
+	disk_statistic.dma_kib_per_second = disk_benchmark_sequential_read(DISK_BENCHMARK_BLOCK_COUNT, true);
+	disk_statistic.pio_kib_per_second = disk_benchmark_sequential_read(DISK_BENCHMARK_BLOCK_COUNT, false);
+#endif
 	initialize_filesystem_fat32();
 
 	/* Mounting VFS */
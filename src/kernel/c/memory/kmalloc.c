@@ -1,12 +1,23 @@
 #include "memory/kmalloc.h"
 #include "driver/tty.h"
 #include "kernel-entrypoint.h"
+#include "memory/paging.h"
 #include "text/framebuffer.h"
 #include <std/stdbool.h>
 #include <std/stddef.h>
 
-#define SMALLEST_BLOCK 0x100
-#define BIT_IN_BYTE 8
+// Large block: header, payload, then footer repeating size for left neighbour
+#define BLOCK_HEADER_SIZE 8
+#define BLOCK_FOOTER_SIZE 4
+#define BLOCK_ALIGN 8
+#define BLOCK_MIN_SIZE 32
+
+// Small objects come from size-class slabs, one SLAB_PAGE_SIZE page per slab
+#define SLAB_PAGE_SIZE 0x1000
+#define SLAB_MAX_OBJECT (SLAB_MIN_OBJECT << (SLAB_CLASS_COUNT - 1))
+// Heap fills rest of first 4 MiB of kernel half, then grows by mapping page frames after it
+#define HEAP_FRAME_COUNT_MAX 8
+#define HEAP_PAGE_COUNT ((HEAP_FRAME_COUNT_MAX + 1) * PAGE_FRAME_SIZE / SLAB_PAGE_SIZE)
 
 // All struct local here
 struct Heap {
@@ -19,100 +30,353 @@ static struct Heap heap = {
 		.end = (void *)&_linker_kernel_break_address,
 };
 
+/**
+ * Block, header of large block placed right before its payload
+ *
+ * @param size      Whole block size including header and footer
+ * @param used      Block is allocated
+ * @param prev_free Previous free block, only while free (overlap payload)
+ * @param next_free Next free block, only while free (overlap payload)
+ */
 struct Block {
 	uint32_t size;
-	bool used;
-	struct Block *prev;
-	struct Block *next;
-	void *data;
+	uint32_t used;
+	struct Block *prev_free;
+	struct Block *next_free;
 };
 
-static struct Block *start_block = NULL;
+static struct Block *free_list = NULL;
+static void *heap_limit = NULL; // End of managed heap, NULL until first allocation
 
-void *kmalloc_aligned(uint32_t size, uint32_t align) {
-	if (start_block == NULL) {
-		int heap_size = (heap.end - heap.start) / BIT_IN_BYTE;
-		start_block = heap.start;
-		start_block->size = heap_size - sizeof(struct Block);
-		start_block->used = false;
-		start_block->next = NULL;
-		start_block->prev = NULL;
-		start_block->data = (char *)start_block + sizeof(struct Block);
-	}
+/**
+ * SlabPage, header at the start of every slab page
+ *
+ * @param prev       Previous page of class that still has free object
+ * @param next       Next page of class that still has free object
+ * @param free       Free object list, next pointer kept inside free object
+ * @param used       Allocated object count
+ * @param size_class Index of object size, object size is SLAB_MIN_OBJECT << size_class
+ */
+struct SlabPage {
+	struct SlabPage *prev;
+	struct SlabPage *next;
+	void *free;
+	uint16_t used;
+	uint8_t size_class;
+};
+
+// Pages with at least one free object, per class
+static struct SlabPage *partial_slab[SLAB_CLASS_COUNT];
+// Size class + 1 of heap page, 0 for page that belong to large block
+static uint8_t heap_page_class[HEAP_PAGE_COUNT];
+
+// Running counters, gauges of KmallocStatistic are computed on request
+static struct KmallocStatistic counter = {0};
+
+static uint32_t heap_page_index(void *address) {
+	return (uint32_t)((char *)address - (char *)heap.start) / SLAB_PAGE_SIZE;
+}
+
+static uint32_t object_offset(uint32_t object_size) {
+	return (sizeof(struct SlabPage) + object_size - 1) / object_size * object_size;
+}
+
+static struct Block *right_neighbour(struct Block *block) {
+	struct Block *next = (void *)((char *)block + block->size);
+	return (void *)next < heap_limit ? next : NULL;
+}
+
+static struct Block *left_neighbour(struct Block *block) {
+	if ((void *)block == heap.start)
+		return NULL;
+	uint32_t left_size = *(uint32_t *)((char *)block - BLOCK_FOOTER_SIZE);
+	return (void *)((char *)block - left_size);
+}
+
+static void set_size(struct Block *block, uint32_t size) {
+	block->size = size;
+	*(uint32_t *)((char *)block + size - BLOCK_FOOTER_SIZE) = size;
+}
+
+static void push_free(struct Block *block) {
+	block->used = false;
+	block->prev_free = NULL;
+	block->next_free = free_list;
+	if (free_list != NULL)
+		free_list->prev_free = block;
+	free_list = block;
+}
+
+static void remove_free(struct Block *block) {
+	if (block->prev_free != NULL)
+		block->prev_free->next_free = block->next_free;
+	else
+		free_list = block->next_free;
+	if (block->next_free != NULL)
+		block->next_free->prev_free = block->prev_free;
+}
 
-	(void)align;
-
-	void *result = NULL;
-	struct Block *current_block = start_block;
-	while (current_block != NULL) {
-		uint32_t base_data = (uint32_t)((char *)current_block + sizeof(struct Block));
-		uint32_t align_padding = base_data % align;
-		if (align_padding != 0) align_padding = align - align_padding;
-		uint32_t aligned_size = size + align_padding;
-
-		if (aligned_size < SMALLEST_BLOCK)
-			aligned_size = SMALLEST_BLOCK;
-
-		if (!current_block->used && current_block->size >= aligned_size) {
-			uint32_t unused_size = current_block->size - aligned_size;
-			if (unused_size > (sizeof(struct Block) + SMALLEST_BLOCK)) { // Creating new block
-				struct Block *new_block = (void *)(((char *)current_block) + sizeof(struct Block) + aligned_size);
-				new_block->size = unused_size - sizeof(struct Block);
-				new_block->used = false;
-				new_block->next = current_block->next;
-				new_block->prev = current_block;
-				new_block->data = (char *)new_block + sizeof(struct Block);
-
-				current_block->next = new_block;
-				current_block->size = aligned_size;
-			}
-
-			current_block->used = true;
-			result = (void *)((char *)current_block + sizeof(struct Block) + align_padding);
-			current_block->data = result;
+static void large_free(void *address);
+
+// Whole linker break window, heap.end is 4 MiB aligned so growth frames follow it
+static void initialize_heap() {
+	uint32_t heap_size = heap.end - heap.start;
+	heap_limit = heap.end;
+
+	struct Block *block = heap.start;
+	set_size(block, heap_size);
+	push_free(block);
+}
+
+// Map enough frames after heap_limit for size bytes, new space merge with free tail
+static bool grow_heap(uint32_t size) {
+	char *old_limit = heap_limit;
+	char *max_limit = (char *)heap.end + HEAP_FRAME_COUNT_MAX * PAGE_FRAME_SIZE;
+	while ((uint32_t)((char *)heap_limit - old_limit) < size) {
+		if (heap_limit == max_limit || !paging_allocate_kernel_page_frame(heap_limit))
 			break;
+		heap_limit = (char *)heap_limit + PAGE_FRAME_SIZE;
+	}
+	if (heap_limit == old_limit)
+		return false;
+
+	struct Block *block = (void *)old_limit;
+	set_size(block, (char *)heap_limit - old_limit);
+	block->used = true;
+	large_free((char *)block + BLOCK_HEADER_SIZE);
+	return (uint32_t)((char *)heap_limit - old_limit) >= size;
+}
+
+// Give back top frames once nothing in them is allocated. One free frame is kept as spare,
+// so allocation straddling heap_limit does not map and unmap it on every alloc/free pair
+static void shrink_heap() {
+	while (heap_limit > heap.end) {
+		struct Block *last = left_neighbour(heap_limit);
+		char *frame = (char *)heap_limit - PAGE_FRAME_SIZE;
+		if (last->used || (char *)last > frame - PAGE_FRAME_SIZE)
+			return;
+
+		// Free tail still covers the spare frame below, it stays in free list
+		set_size(last, frame - (char *)last);
+		heap_limit = frame;
+		paging_free_kernel_page_frame(frame);
+	}
+}
+
+static void *first_fit(uint32_t needed, uint32_t align) {
+	for (struct Block *block = free_list; block != NULL; block = block->next_free) {
+		uint32_t payload = ((uint32_t)block + BLOCK_HEADER_SIZE + align - 1) & ~(align - 1);
+		uint32_t gap = payload - BLOCK_HEADER_SIZE - (uint32_t)block;
+		while (gap != 0 && gap < BLOCK_MIN_SIZE) { // Gap in front must be able to stand as a free block
+			payload += align;
+			gap += align;
+		}
+		if (gap + needed > block->size)
+			continue;
+
+		// Front gap stays in free list, block starts right before aligned payload
+		if (gap != 0) {
+			struct Block *front = block;
+			block = (void *)((char *)front + gap);
+			set_size(block, front->size - gap);
+			set_size(front, gap);
+		} else {
+			remove_free(block);
+		}
+
+		if (block->size - needed >= BLOCK_MIN_SIZE) {
+			struct Block *rest = (void *)((char *)block + needed);
+			set_size(rest, block->size - needed);
+			push_free(rest);
+			set_size(block, needed);
 		}
 
-		current_block = current_block->next;
+		block->used = true;
+		return (void *)payload;
 	}
+	return NULL;
+}
+
+static void *large_alloc(uint32_t size, uint32_t align) {
+	if (heap_limit == NULL)
+		initialize_heap();
+	if (align < BLOCK_ALIGN)
+		align = BLOCK_ALIGN;
 
+	uint32_t needed = (size + BLOCK_HEADER_SIZE + BLOCK_FOOTER_SIZE + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+	if (needed < BLOCK_MIN_SIZE)
+		needed = BLOCK_MIN_SIZE;
+
+	void *result = first_fit(needed, align);
+	// Worst case the fit needs alignment gap in front of it
+	if (result == NULL && grow_heap(needed + align + BLOCK_MIN_SIZE))
+		result = first_fit(needed, align);
+	// Partial growth that still did not fit is given back
+	if (result == NULL)
+		shrink_heap();
 	return result;
 };
 
-void *kmalloc(uint32_t size) {
-	return kmalloc_aligned(size, 4);
+// Merge with free neighbours through boundary tags, no heap walk
+static void large_free(void *address) {
+	if (heap_limit == NULL || address < heap.start || address >= heap_limit) return;
+
+	struct Block *block = (void *)((char *)address - BLOCK_HEADER_SIZE);
+	if (!block->used) return;
+
+	struct Block *right = right_neighbour(block);
+	if (right != NULL && !right->used) {
+		remove_free(right);
+		set_size(block, block->size + right->size);
+	}
+
+	struct Block *left = left_neighbour(block);
+	if (left != NULL && !left->used) {
+		remove_free(left);
+		set_size(left, left->size + block->size);
+		block = left;
+	}
+
+	push_free(block);
 };
 
-static void combine_block(struct Block *prev, struct Block *next) {
-	prev->size += sizeof(struct Block) + next->size;
-	prev->next = next->next;
-	if (next->next != NULL)
-		next->next->prev = prev;
+static void unlink_partial(struct SlabPage *page) {
+	if (page->prev != NULL)
+		page->prev->next = page->next;
+	else
+		partial_slab[page->size_class] = page->next;
+	if (page->next != NULL)
+		page->next->prev = page->prev;
+	page->prev = NULL;
+	page->next = NULL;
 }
 
-void kfree(void *address) {
-	if (start_block == NULL) return;
+static void push_partial(struct SlabPage *page) {
+	page->prev = NULL;
+	page->next = partial_slab[page->size_class];
+	if (page->next != NULL)
+		page->next->prev = page;
+	partial_slab[page->size_class] = page;
+}
+
+// Carve new page into free objects of size class
+static struct SlabPage *grow_slab(uint8_t size_class) {
+	struct SlabPage *page = large_alloc(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+	if (page == NULL)
+		return NULL;
 
-	struct Block *current_block = start_block;
-	while (current_block != NULL) {
-		if (current_block->used && current_block->data == address) {
-			current_block->used = false;
+	uint32_t object_size = SLAB_MIN_OBJECT << size_class;
+	page->used = 0;
+	page->size_class = size_class;
+	page->free = NULL;
+	for (uint32_t offset = SLAB_PAGE_SIZE - object_size; offset >= object_offset(object_size); offset -= object_size) {
+		void **object = (void **)((char *)page + offset);
+		*object = page->free;
+		page->free = object;
+	}
 
-			if (current_block->next != NULL && !current_block->next->used)
-				combine_block(current_block, current_block->next);
+	heap_page_class[heap_page_index(page)] = size_class + 1;
+	counter.slab_page[size_class] += 1;
+	push_partial(page);
+	return page;
+}
 
-			if (current_block->prev != NULL && !current_block->prev->used)
-				combine_block(current_block->prev, current_block);
+static void *slab_alloc(uint8_t size_class) {
+	struct SlabPage *page = partial_slab[size_class];
+	if (page == NULL)
+		page = grow_slab(size_class);
+	if (page == NULL)
+		return NULL;
 
-			break;
-		}
+	void **object = page->free;
+	page->free = *object;
+	page->used += 1;
+	counter.slab_object[size_class] += 1;
+	if (page->free == NULL)
+		unlink_partial(page);
+	return object;
+}
 
-		current_block = current_block->next;
+static void slab_free(struct SlabPage *page, void *address) {
+	bool was_full = page->free == NULL;
+	void **object = address;
+	*object = page->free;
+	page->free = object;
+	page->used -= 1;
+	counter.slab_object[page->size_class] -= 1;
+
+	if (was_full)
+		push_partial(page);
+
+	// Empty page goes back to large blocks, unless it is the only one left for its class
+	// and sits in fixed part of heap, where it can not keep a grown frame mapped
+	bool keep = page->prev == NULL && page->next == NULL && (void *)page < heap.end;
+	if (page->used == 0 && !keep) {
+		unlink_partial(page);
+		heap_page_class[heap_page_index(page)] = 0;
+		counter.slab_page[page->size_class] -= 1;
+		large_free(page);
 	}
+}
+
+void *kmalloc_aligned(uint32_t size, uint32_t align) {
+	void *result;
+	// Every object is aligned to its size, smallest class covers align up to SLAB_MIN_OBJECT
+	if (size <= SLAB_MAX_OBJECT && align <= SLAB_MIN_OBJECT) {
+		uint8_t size_class = 0;
+		while ((uint32_t)(SLAB_MIN_OBJECT << size_class) < size)
+			size_class += 1;
+		result = slab_alloc(size_class);
+	} else {
+		result = large_alloc(size, align);
+	}
+
+	if (result != NULL)
+		counter.allocation += 1;
+	else
+		counter.failure += 1;
+	return result;
+}
+
+void *kmalloc(uint32_t size) {
+	return kmalloc_aligned(size, 4);
 };
 
+void kfree(void *address) {
+	if (address == NULL || heap_limit == NULL) return;
+
+	counter.release += 1;
+	uint32_t page_index = heap_page_index(address);
+	if (page_index < HEAP_PAGE_COUNT && heap_page_class[page_index] != 0) {
+		struct SlabPage *page = (void *)((uint32_t)address & ~(SLAB_PAGE_SIZE - 1));
+		slab_free(page, address);
+	} else {
+		large_free(address);
+	}
+	shrink_heap();
+};
+
+void kmalloc_get_statistic(struct KmallocStatistic *statistic) {
+	*statistic = counter;
+	if (heap_limit == NULL)
+		return;
+
+	statistic->heap_size = (char *)heap_limit - (char *)heap.start;
+	for (struct Block *block = heap.start; block != NULL; block = right_neighbour(block)) {
+		if (block->used) {
+			statistic->used += block->size;
+			statistic->used_block += 1;
+			continue;
+		}
+		statistic->free += block->size;
+		statistic->free_block += 1;
+		if (block->size > statistic->largest_free)
+			statistic->largest_free = block->size;
+	}
+}
+
 // void ktest() {
-// 	struct Block *current_block = start_block;
+// 	struct Block *current_block = heap.start;
 // 	while (current_block != NULL) {
 // 		fputc('\n');
 //
@@ -120,13 +384,9 @@ void kfree(void *address) {
 // 		fputc(' ');
 // 		framebuffer_put_hex((uint32_t)current_block->size);
 // 		fputc(' ');
-// 		framebuffer_put_hex((uint32_t)current_block->data);
-// 		fputc(' ');
-// 		framebuffer_put_hex((uint32_t)current_block->prev);
-// 		fputc(' ');
-// 		framebuffer_put_hex((uint32_t)current_block->next);
+// 		framebuffer_put_hex((uint32_t)current_block + BLOCK_HEADER_SIZE);
 // 		fputc(' ');
 //
-// 		current_block = current_block->next;
+// 		current_block = right_neighbour(current_block);
 // 	}
 // }
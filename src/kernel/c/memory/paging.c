@@ -33,12 +33,39 @@ __attribute__((aligned(0x1000))
 						 },
 		 }};
 
+// Frame 0 hold kernel program, frame 1 kernel stack
 static struct PageManagerState page_manager_state = {
-		.mapped = {
-				[0] = true,
-				[1] = true
-		},
-		.free_page_frame_count = PAGE_FRAME_MAX_COUNT
+		.free_frame_map = ~(uint32_t)0x3,
+		.free_page_frame_count = PAGE_FRAME_MAX_COUNT - 2
+};
+
+/**
+ * PageDirectoryRecord, reverse map from page directory to physical frames it own
+ *
+ * @param dir             Page directory, NULL if record is unused
+ * @param owned_frame_map Bit i is set while physical frame i is mapped by dir
+ */
+struct PageDirectoryRecord {
+	struct PageDirectory *dir;
+	uint32_t owned_frame_map;
+};
+
+// Kernel heap frames, kernel program and stack frames are never released
+static struct PageDirectoryRecord kernel_directory_record = {.dir = &_paging_kernel_page_directory};
+
+// Every process page directory, kernel half entries are kept equal to kernel page directory
+static struct PageDirectoryRecord page_directory_list[PAGING_DIRECTORY_TABLE_MAX_COUNT];
+
+/**
+ * Process page directory as allocated, record slot is stored right after the directory
+ * so finding its record does not scan page_directory_list
+ *
+ * @param dir         Page directory handed out by paging_create_new_page_directory()
+ * @param record_slot Index of its record in page_directory_list
+ */
+struct ProcessPageDirectory {
+	struct PageDirectory dir;
+	uint32_t record_slot;
 };
 
 void update_page_directory_entry(
@@ -57,48 +84,64 @@ void flush_single_tlb(void *virtual_addr) {
 }
 
 /* --- Memory Management --- */
-bool paging_allocate_check(uint32_t amount) {
-	return amount <= page_manager_state.free_page_frame_count;
+static struct PageDirectoryRecord *find_directory_record(struct PageDirectory *page_dir) {
+	if (page_dir == &_paging_kernel_page_directory)
+		return &kernel_directory_record;
+
+	uint32_t slot = ((struct ProcessPageDirectory *)page_dir)->record_slot;
+	if (slot >= PAGING_DIRECTORY_TABLE_MAX_COUNT || page_directory_list[slot].dir != page_dir)
+		return NULL;
+	return &page_directory_list[slot];
+}
+
+// Lowest free physical frame now owned by record, -1 if memory is full
+static int reserve_page_frame(struct PageDirectoryRecord *record) {
+	if (record == NULL || page_manager_state.free_frame_map == 0) return -1;
+
+	int i = __builtin_ctz(page_manager_state.free_frame_map);
+	page_manager_state.free_frame_map &= ~(1u << i);
+	page_manager_state.free_page_frame_count -= 1;
+	record->owned_frame_map |= 1u << i;
+	return i;
+}
+
+// Frame mapped at virtual_addr is read back from the entry itself, -1 if record does not own it
+static int find_page_frame(struct PageDirectoryRecord *record, void *virtual_addr) {
+	if (record == NULL) return -1;
+
+	struct PageDirectoryEntry *entry = &record->dir->table[((uint32_t)virtual_addr >> 22) & 0x3FF];
+	uint32_t i = entry->lower_address;
+	if (!entry->flag.present_bit || i >= PAGE_FRAME_MAX_COUNT || !(record->owned_frame_map & (1u << i)))
+		return -1;
+	return i;
+}
+
+static void release_page_frame(struct PageDirectoryRecord *record, int i) {
+	record->owned_frame_map &= ~(1u << i);
+	page_manager_state.free_frame_map |= 1u << i;
+	page_manager_state.free_page_frame_count += 1;
 }
 
 bool paging_allocate_user_page_frame(
 		struct PageDirectory *page_dir, void *virtual_addr
 ) {
-	if (page_manager_state.free_page_frame_count == 0) return false;
-
-	int i = 0;
-	while (i < PAGE_FRAME_MAX_COUNT) {
-		if (page_manager_state.mapped[i] == false) break;
-		++i;
-	}
-	if (i == PAGE_FRAME_MAX_COUNT) return false;
+	int i = reserve_page_frame(find_directory_record(page_dir));
+	if (i < 0) return false;
 
 	update_page_directory_entry(
 			page_dir, (void *)(i * PAGE_FRAME_SIZE), virtual_addr,
 			(struct PageDirectoryEntryFlag
 			){.present_bit = 1, .write_bit = 1, .user = 1, .use_pagesize_4_mb = 1}
 	);
-
-	page_manager_state.mapped_address[i] = virtual_addr;
-	page_manager_state.mapped_dir[i] = page_dir;
-	page_manager_state.mapped[i] = true;
-	page_manager_state.free_page_frame_count -= 1;
 	return true;
 }
 
 bool paging_free_user_page_frame(
 		struct PageDirectory *page_dir, void *virtual_addr
 ) {
-	int i = 0;
-	while (i < PAGE_FRAME_MAX_COUNT) {
-		if (
-				page_manager_state.mapped_address[i] == virtual_addr &&
-				page_manager_state.mapped_dir[i] == page_dir
-		) break;
-		++i;
-	}
-
-	if (i == PAGE_FRAME_MAX_COUNT) return false;
+	struct PageDirectoryRecord *record = find_directory_record(page_dir);
+	int i = find_page_frame(record, virtual_addr);
+	if (i < 0) return false;
 
 	update_page_directory_entry(
 			page_dir, (void *)0, virtual_addr,
@@ -106,58 +149,113 @@ bool paging_free_user_page_frame(
 			){.present_bit = 0, .write_bit = 0, .user = 0, .use_pagesize_4_mb = 0}
 	);
 
-	page_manager_state.mapped[i] = false;
-	page_manager_state.free_page_frame_count += 1;
-	page_manager_state.mapped_address[i] = NULL;
-	page_manager_state.mapped_dir[i] = NULL;
+	release_page_frame(record, i);
 	return true;
 }
 
+/* --- Kernel Memory Management --- */
+// Same kernel half entry on kernel page directory and every process page directory
+static void update_kernel_entry(void *physical_addr, void *virtual_addr, struct PageDirectoryEntryFlag flag) {
+	update_page_directory_entry(&_paging_kernel_page_directory, physical_addr, virtual_addr, flag);
+	for (int i = 0; i < PAGING_DIRECTORY_TABLE_MAX_COUNT; ++i) {
+		if (page_directory_list[i].dir != NULL)
+			update_page_directory_entry(page_directory_list[i].dir, physical_addr, virtual_addr, flag);
+	}
+}
+
+bool paging_allocate_kernel_page_frame(void *virtual_addr) {
+	int i = reserve_page_frame(&kernel_directory_record);
+	if (i < 0) return false;
+
+	update_kernel_entry(
+			(void *)(i * PAGE_FRAME_SIZE), virtual_addr,
+			(struct PageDirectoryEntryFlag){.present_bit = 1, .write_bit = 1, .use_pagesize_4_mb = 1}
+	);
+	return true;
+}
+
+bool paging_free_kernel_page_frame(void *virtual_addr) {
+	int i = find_page_frame(&kernel_directory_record, virtual_addr);
+	if (i < 0) return false;
+
+	update_kernel_entry((void *)0, virtual_addr, (struct PageDirectoryEntryFlag){.present_bit = 0});
+	release_page_frame(&kernel_directory_record, i);
+	return true;
+}
+
+void *paging_virtual_to_physical(void *virtual_addr) {
+	struct PageDirectoryEntry *entry = &_paging_kernel_page_directory.table[((uint32_t)virtual_addr >> 22) & 0x3FF];
+	return (void *)(((uint32_t)entry->lower_address << 22) | ((uint32_t)virtual_addr & (PAGE_FRAME_SIZE - 1)));
+}
+
+static void *physical_to_kernel_virtual(uint32_t physical_addr) {
+	for (uint32_t j = KERNEL_VIRTUAL_ADDRESS_BASE >> 22; j < PAGE_ENTRY_COUNT; ++j) {
+		struct PageDirectoryEntry *entry = &_paging_kernel_page_directory.table[j];
+		if (entry->flag.present_bit && entry->lower_address == (physical_addr >> 22))
+			return (void *)((j << 22) | (physical_addr & (PAGE_FRAME_SIZE - 1)));
+	}
+	return NULL;
+}
+
+/* --- Page Fault --- */
+void *paging_get_fault_address(void) {
+	uint32_t fault_addr;
+	__asm__ volatile("mov %%cr2, %0" : "=r"(fault_addr) : /* <Empty> */);
+	return (void *)fault_addr;
+}
+
 struct PageDirectory *paging_create_new_page_directory(void) {
-	struct PageDirectory *dir = kmalloc_aligned(sizeof(struct PageDirectory), 0x1000);
-	if (dir == NULL)
+	struct ProcessPageDirectory *process_dir = kmalloc_aligned(sizeof(struct ProcessPageDirectory), 0x1000);
+	if (process_dir == NULL)
 		return NULL;
+	struct PageDirectory *dir = &process_dir->dir;
 
+	int slot = 0;
+	while (slot < PAGING_DIRECTORY_TABLE_MAX_COUNT && page_directory_list[slot].dir != NULL)
+		++slot;
+	if (slot == PAGING_DIRECTORY_TABLE_MAX_COUNT) {
+		kfree(dir);
+		return NULL;
+	}
+
+	// Kernel program, kernel heap and kernel stack
 	memset(dir, 0, sizeof(struct PageDirectory));
-	dir->table[0x300] = (struct PageDirectoryEntry){
-			.flag.present_bit = 1,
-			.flag.write_bit = 1,
-			.flag.use_pagesize_4_mb = 1,
-			.lower_address = 0,
-	};
-	dir->table[0x3FF] = (struct PageDirectoryEntry){
-			.flag.present_bit = 1,
-			.flag.write_bit = 1,
-			.flag.use_pagesize_4_mb = 1,
-			.lower_address = ((1 * PAGE_FRAME_SIZE) >> 22) & 0x3FF,
-	};
+	for (uint32_t j = KERNEL_VIRTUAL_ADDRESS_BASE >> 22; j < PAGE_ENTRY_COUNT; ++j)
+		dir->table[j] = _paging_kernel_page_directory.table[j];
 
+	process_dir->record_slot = slot;
+	page_directory_list[slot].dir = dir;
+	page_directory_list[slot].owned_frame_map = 0;
 	return dir;
 }
 
 bool paging_free_page_directory(struct PageDirectory *page_dir) {
-	for (int j = 0; j < PAGE_FRAME_MAX_COUNT; ++j) {
-		struct PageDirectoryEntry *entry = &(page_dir->table[j]);
-		if (entry->flag.present_bit)
-			paging_free_user_page_frame(page_dir, (void *)(PAGE_FRAME_SIZE * j));
-	}
+	struct PageDirectoryRecord *record = find_directory_record(page_dir);
+	if (record == NULL || record == &kernel_directory_record)
+		return false;
+
+	// Only frames this directory own, entries are dropped together with the directory.
+	// Directory is never the active one here, so no stale TLB entry is left behind
+	while (record->owned_frame_map != 0)
+		release_page_frame(record, __builtin_ctz(record->owned_frame_map));
+	record->dir = NULL;
 
 	memset(page_dir, 0, sizeof(struct PageDirectory));
 	kfree(page_dir);
-	return false;
+	return true;
 }
 
 struct PageDirectory *paging_get_current_page_directory_addr(void) {
 	uint32_t current_page_directory_phys_addr;
 	__asm__ volatile("mov %%cr3, %0" : "=r"(current_page_directory_phys_addr) : /* <Empty> */);
-	uint32_t virtual_addr_page_dir = current_page_directory_phys_addr + KERNEL_VIRTUAL_ADDRESS_BASE;
-	return (struct PageDirectory *)virtual_addr_page_dir;
+	// Page directory may live in heap frame outside linearly mapped kernel image
+	return physical_to_kernel_virtual(current_page_directory_phys_addr);
 }
 
 void paging_use_page_directory(struct PageDirectory *page_dir_virtual_addr) {
 	uint32_t physical_addr_page_dir = (uint32_t)page_dir_virtual_addr;
 	// Additional layer of check & mistake safety net
 	if ((uint32_t)page_dir_virtual_addr > KERNEL_VIRTUAL_ADDRESS_BASE)
-		physical_addr_page_dir -= KERNEL_VIRTUAL_ADDRESS_BASE;
+		physical_addr_page_dir = (uint32_t)paging_virtual_to_physical(page_dir_virtual_addr);
 	__asm__ volatile("mov %0, %%cr3" : /* <Empty> */ : "r"(physical_addr_page_dir) : "memory");
 }
@@ -0,0 +1,97 @@
+#include "process/exec_cache.h"
+#include "memory/kmalloc.h"
+#include <std/string.h>
+
+struct ExecCacheStatistic exec_cache_statistic = {0};
+
+static struct ExecCacheEntry exec_cache[EXEC_CACHE_ENTRY_COUNT];
+static uint32_t exec_counter = 0;
+
+static void drop_entry(struct ExecCacheEntry *cache_entry) {
+	kfree(cache_entry->image);
+	exec_cache_statistic.used -= cache_entry->size;
+	cache_entry->image = NULL;
+	cache_entry->path[0] = '\0';
+}
+
+static struct ExecCacheEntry *find_entry(char *path) {
+	for (int i = 0; i < EXEC_CACHE_ENTRY_COUNT; ++i) {
+		if (exec_cache[i].image != NULL && strcmp(exec_cache[i].path, path) == 0)
+			return &exec_cache[i];
+	}
+	return NULL;
+}
+
+static struct ExecCacheEntry *least_recently_used() {
+	struct ExecCacheEntry *result = NULL;
+	for (int i = 0; i < EXEC_CACHE_ENTRY_COUNT; ++i) {
+		if (exec_cache[i].image == NULL) continue;
+		if (result == NULL || exec_cache[i].last_used < result->last_used)
+			result = &exec_cache[i];
+	}
+	return result;
+}
+
+bool exec_cache_load(char *path, struct VFSEntry *entry, void *destination) {
+	struct ExecCacheEntry *cache_entry = find_entry(path);
+	if (cache_entry == NULL) {
+		exec_cache_statistic.miss += 1;
+		return false;
+	}
+
+	// Same path now name another file, or file was replaced behind our back
+	if (cache_entry->size != (uint32_t)entry->size || cache_entry->location != entry->location) {
+		drop_entry(cache_entry);
+		exec_cache_statistic.invalidation += 1;
+		exec_cache_statistic.miss += 1;
+		return false;
+	}
+
+	memcpy(destination, cache_entry->image, cache_entry->size);
+	cache_entry->last_used = ++exec_counter;
+	exec_cache_statistic.hit += 1;
+	return true;
+}
+
+void exec_cache_insert(char *path, struct VFSEntry *entry, void *image) {
+	uint32_t size = entry->size;
+	if (entry->location == 0 || size == 0 || size > EXEC_CACHE_BUDGET || str_len(path) >= EXEC_CACHE_PATH_SIZE)
+		return;
+
+	struct ExecCacheEntry *cache_entry = find_entry(path);
+	if (cache_entry != NULL)
+		drop_entry(cache_entry);
+
+	// Evict until both budget and a slot are available
+	while (true) {
+		cache_entry = NULL;
+		for (int i = 0; i < EXEC_CACHE_ENTRY_COUNT && cache_entry == NULL; ++i) {
+			if (exec_cache[i].image == NULL)
+				cache_entry = &exec_cache[i];
+		}
+		if (cache_entry != NULL && exec_cache_statistic.used + size <= EXEC_CACHE_BUDGET)
+			break;
+
+		drop_entry(least_recently_used());
+		exec_cache_statistic.eviction += 1;
+	}
+
+	cache_entry->image = kmalloc(size);
+	if (cache_entry->image == NULL)
+		return;
+	memcpy(cache_entry->image, image, size);
+	strcpy(cache_entry->path, path, EXEC_CACHE_PATH_SIZE);
+	cache_entry->size = size;
+	cache_entry->location = entry->location;
+	cache_entry->last_used = ++exec_counter;
+	exec_cache_statistic.used += size;
+}
+
+void exec_cache_invalidate(uint32_t location) {
+	for (int i = 0; i < EXEC_CACHE_ENTRY_COUNT; ++i) {
+		if (exec_cache[i].image != NULL && exec_cache[i].location == location) {
+			drop_entry(&exec_cache[i]);
+			exec_cache_statistic.invalidation += 1;
+		}
+	}
+}
@@ -4,6 +4,7 @@
 #include "memory/kmalloc.h"
 #include "memory/memory.h"
 #include "memory/paging.h"
+#include "process/exec_cache.h"
 #include "process/file_descriptor.h"
 #include "process/scheduler.h"
 #include <path.h>
@@ -66,15 +67,17 @@ void setup_register(struct ProcessControlBlock *pcb) {
 	frame->int_stack.cs = 0x18 | 0x3;
 	frame->int_stack.eip = 0; // Assume always start at 0
 	frame->int_stack.error_code = 0;
-	frame->int_stack.old_esp = 0x400000 - 4;
+	frame->int_stack.old_esp = PROCESS_STACK_TOP - 4;
 	frame->int_stack.ss = segment;
 
 	frame->int_number = 0;
 }
 
 int process_create(char *p) {
-	// Path needs to be copied, since we will be changing page directory
+	// Path may live in caller user memory, keep kernel copy of it
 	COPY_STRING_TO_LOCAL(path, p);
+	if (p_size > PROCESS_IMAGE_PATH_LENGTH_MAX)
+		return -1;
 
 	struct ProcessControlBlock *pcb = kmalloc(sizeof(struct ProcessControlBlock));
 	struct PageDirectory *page_directory = paging_create_new_page_directory();
@@ -90,9 +93,9 @@ int process_create(char *p) {
 	if (status != 0 || entry.type != File)
 		goto error;
 
-	// Check whether memory is enough for the executable and additional frame for user stack
+	// Executable and first frame of user stack must fit the process, frames are taken on first touch
 	uint32_t page_frame_count_needed = (entry.size + PAGE_FRAME_SIZE + PAGE_FRAME_SIZE - 1) / PAGE_FRAME_SIZE;
-	if (!paging_allocate_check(page_frame_count_needed) || page_frame_count_needed > PROCESS_PAGE_FRAME_COUNT_MAX) goto error;
+	if (page_frame_count_needed > PROCESS_PAGE_FRAME_COUNT_MAX) goto error;
 
 	int pid = get_free_pid();
 	if (pid < 0) goto error;
@@ -102,23 +105,13 @@ int process_create(char *p) {
 	for (int i = 0; i < PROCESS_MAX_FD; ++i)
 		pcb->fd[i] = -1;
 
-	struct PageDirectory *current_page_directory = paging_get_current_page_directory_addr();
-	void *program_base_address = 0;
-	status = paging_allocate_user_page_frame(page_directory, program_base_address);
-	if (!status) goto error;
-
-	paging_use_page_directory(page_directory);
-	int ft = vfs.open(path);
-	if (ft < 0)
-		goto error;
-	vfs.read(ft, program_base_address, entry.size);
-	vfs.close(ft);
-	paging_use_page_directory(current_page_directory);
+	// Nothing is mapped yet, first instruction fetch fault in the program frame
+	strcpy(pcb->image.path, path, PROCESS_IMAGE_PATH_LENGTH_MAX);
+	pcb->image.size = entry.size;
+	pcb->image.location = entry.location;
 
 	setup_register(pcb);
 	pcb->context.memory.page_directory_virtual_addr = page_directory;
-	pcb->context.memory.virtual_addr_used[0] = program_base_address;
-	pcb->context.memory.page_frame_used_count += 1;
 
 	process_manager_state.active_process_count += 1;
 
@@ -151,6 +144,138 @@ int process_destroy(int pid) {
 	return 0;
 };
 
+static bool map_frame(struct ProcessControlBlock *pcb, void *virtual_addr) {
+	if (pcb->context.memory.page_frame_used_count >= PROCESS_PAGE_FRAME_COUNT_MAX)
+		return false;
+	if (!paging_allocate_user_page_frame(pcb->context.memory.page_directory_virtual_addr, virtual_addr))
+		return false;
+	pcb->context.memory.virtual_addr_used[pcb->context.memory.page_frame_used_count++] = virtual_addr;
+	return true;
+}
+
+// Undo map_frame of the last mapped frame, its content must not stay reachable
+static void unmap_last_frame(struct ProcessControlBlock *pcb) {
+	void *virtual_addr = pcb->context.memory.virtual_addr_used[--pcb->context.memory.page_frame_used_count];
+	paging_free_user_page_frame(pcb->context.memory.page_directory_virtual_addr, virtual_addr);
+}
+
+/**
+ * Fill just mapped program frame with its part of executable
+ *
+ * @param frame_base Virtual address of frame, also file offset of its content
+ */
+static bool fill_image_frame(struct ProcessControlBlock *pcb, uint32_t frame_base) {
+	char *path = pcb->image.path;
+	struct VFSEntry entry;
+	if (vfs.stat(path, &entry) != 0 || (uint32_t)entry.size != pcb->image.size || entry.location != pcb->image.location)
+		return false;
+
+	char *frame = (char *)frame_base;
+	uint32_t size = pcb->image.size - frame_base;
+	if (size > PAGE_FRAME_SIZE)
+		size = PAGE_FRAME_SIZE;
+	// Past image end is program .bss, it must start zeroed and not show old frame content
+	memset(frame + size, 0, PAGE_FRAME_SIZE - size);
+
+	bool whole_image = frame_base == 0 && pcb->image.size <= PAGE_FRAME_SIZE;
+	if (whole_image && exec_cache_load(path, &entry, frame))
+		return true;
+
+	int ft = vfs.open(path);
+	if (ft < 0)
+		return false;
+	bool loaded = vfs.pread(ft, frame, size, frame_base) == (int)size;
+	vfs.close(ft);
+
+	if (loaded && whole_image)
+		exec_cache_insert(path, &entry, frame);
+	return loaded;
+}
+
+/**
+ * Map missing frame of current process
+ *
+ * @param frame_base  Virtual address of frame
+ * @param may_read_fs Program frame may be read from file system here, false for fault raised
+ *                    by kernel code that can be in the middle of a disk transfer
+ */
+static enum PageFaultStatus map_missing_frame(struct ProcessControlBlock *pcb, uint32_t frame_base, bool may_read_fs) {
+	uint32_t image_end = (pcb->image.size + PAGE_FRAME_SIZE - 1) & ~(PAGE_FRAME_SIZE - 1);
+	uint32_t stack_bottom = PROCESS_STACK_TOP - PROCESS_STACK_FRAME_COUNT_MAX * PAGE_FRAME_SIZE;
+
+	// Physical frame may still hold kernel heap or other process data
+	if (frame_base >= stack_bottom && frame_base < PROCESS_STACK_TOP) {
+		if (!map_frame(pcb, (void *)frame_base))
+			return PageFaultOutOfMemory;
+		memset((void *)frame_base, 0, PAGE_FRAME_SIZE);
+		return PageFaultMapped;
+	}
+
+	if (!may_read_fs || frame_base >= image_end)
+		return PageFaultInvalid;
+	if (!map_frame(pcb, (void *)frame_base))
+		return PageFaultOutOfMemory;
+
+	// Not a syscall, reader can not be parked, keep this read synchronous
+	bool may_block = vfs_may_block;
+	vfs_may_block = false;
+	bool filled = fill_image_frame(pcb, frame_base);
+	vfs_may_block = may_block;
+	if (!filled) {
+		unmap_last_frame(pcb);
+		return PageFaultInvalid;
+	}
+	return PageFaultMapped;
+}
+
+enum PageFaultStatus process_handle_page_fault(void *address, uint32_t error_code) {
+	int pid = get_current_running_pid();
+	if (pid < 0 || (error_code & PAGE_FAULT_ERROR_PRESENT))
+		return PageFaultInvalid;
+
+	// Kernel mode fault on program frame can come from memcpy against disk driver buffer,
+	// nested read would reuse that buffer. Syscalls fault in user buffers before using them
+	uint32_t frame_base = (uint32_t)address & ~(PAGE_FRAME_SIZE - 1);
+	return map_missing_frame(get_pcb_from_pid(pid), frame_base, error_code & PAGE_FAULT_ERROR_USER);
+}
+
+bool process_fault_in_user_buffer(void *buffer, uint32_t size) {
+	int pid = get_current_running_pid();
+	if (pid < 0 || size == 0)
+		return true;
+
+	struct ProcessControlBlock *pcb = get_pcb_from_pid(pid);
+	struct PageDirectory *page_dir = pcb->context.memory.page_directory_virtual_addr;
+	uint32_t start = (uint32_t)buffer;
+	uint32_t end = start + size;
+	if (end < start || end > KERNEL_VIRTUAL_ADDRESS_BASE)
+		return false;
+
+	for (uint32_t frame_base = start & ~(PAGE_FRAME_SIZE - 1); frame_base < end; frame_base += PAGE_FRAME_SIZE) {
+		if (page_dir->table[frame_base >> 22].flag.present_bit)
+			continue;
+		if (map_missing_frame(pcb, frame_base, true) != PageFaultMapped)
+			return false;
+	}
+	return true;
+}
+
+bool process_fault_in_user_string(char *str) {
+	if (get_current_running_pid() < 0)
+		return true;
+
+	uint32_t address = (uint32_t)str;
+	while (address < KERNEL_VIRTUAL_ADDRESS_BASE) {
+		uint32_t frame_end = (address & ~(PAGE_FRAME_SIZE - 1)) + PAGE_FRAME_SIZE;
+		if (!process_fault_in_user_buffer((void *)address, 1))
+			return false;
+		for (; address < frame_end; ++address)
+			if (*(char *)address == '\0')
+				return true;
+	}
+	return false;
+}
+
 bool process_sleep_predicate(void *closure) {
 	uint32_t target_second = (uint32_t)closure;
 	return second_elapsed >= target_second;
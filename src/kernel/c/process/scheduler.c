@@ -1,6 +1,7 @@
 #include "process/scheduler.h"
 #include "cpu/interrupt.h"
 #include "cpu/portio.h"
+#include "filesystem/fat32.h"
 #include "memory/kmalloc.h"
 #include "process/process.h"
 #include "text/framebuffer.h"
@@ -116,8 +117,9 @@ void switch_next_with_notifier(struct InterruptFrame *frame) {
 
 		if (next_pcb->metadata.state == Ready) break;
 
-		// Halt till next interrupt
+		// Halt till next interrupt, every waiting syscall is parked so metadata can be flushed
 		if (next_pcb == prev_pcb) {
+			fat32_flush_expired();
 			__asm__ volatile("sti");
 			__asm__ volatile("hlt");
 			__asm__ volatile("cli");
@@ -128,6 +130,7 @@ void switch_next_with_notifier(struct InterruptFrame *frame) {
 	memcpy(frame, &next_pcb->context.frame, sizeof(struct InterruptFrame));
 	next_pcb->metadata.state = Running;
 	if (notified && recall) { // Since halting process always happend on syscall, we must continue interrupt process
+		syscall_return_value_flag = true;
 		syscall_handler(frame);
 		syscall_return_value_flag = false;
 	}
@@ -145,6 +148,9 @@ void scheduler_halt_current_process(bool (*predicate)(), void *closure, bool rec
 
 	memcpy(&pcb->context.frame, current_interrupt_frame, sizeof(struct InterruptFrame));
 	switch_next_with_notifier(current_interrupt_frame);
+
+	// Frame now belong to next process, halted syscall result must not be written into it
+	syscall_return_value_flag = false;
 }
 
 void scheduler_handle_timer_interrupt(struct InterruptFrame *frame) {
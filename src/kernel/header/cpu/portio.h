@@ -24,4 +24,17 @@ uint8_t in(uint16_t port);
 void out16(uint16_t port, uint16_t data);
 uint16_t in16(uint16_t port);
 
+void out32(uint16_t port, uint32_t data);
+uint32_t in32(uint16_t port);
+
+/**
+ *  Transfer count words between port and memory with rep insw / rep outsw
+ *
+ *  @param port   The I/O port
+ *  @param buffer Memory with size of count * 2 bytes
+ *  @param count  Word count
+ */
+void in16_repeat(uint16_t port, void *buffer, uint32_t count);
+void out16_repeat(uint16_t port, const void *buffer, uint32_t count);
+
 #endif
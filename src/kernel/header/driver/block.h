@@ -0,0 +1,85 @@
+#ifndef _BLOCK_H
+#define _BLOCK_H
+
+#include <disk.h>
+#include <std/stdbool.h>
+#include <std/stdint.h>
+
+/* -- Block request queue constants -- */
+#define BLOCK_REQUEST_COUNT 64
+// Merged command is capped to keep every dispatch short, cluster buffers of it fit DMA_PRD_COUNT
+#define BLOCK_MAX_MERGE_BLOCK 256
+
+/**
+ * BlockRequest, one submitted transfer between disk and a kernel buffer
+ *
+ * @param used                  Pool slot is taken
+ * @param write                 Transfer direction, memory to disk
+ * @param logical_block_address First block of transfer
+ * @param block_count           Block count of transfer
+ * @param buffer                Kernel memory with size of block_count * BLOCK_SIZE
+ * @param complete              Called once transfer is done, may be inside interrupt handler
+ * @param closure               Passed to complete
+ * @param next                  Next request, LBA sorted on pending list or in dispatched batch
+ */
+struct BlockRequest {
+	bool used;
+	bool write;
+	uint32_t logical_block_address;
+	uint32_t block_count;
+	uint8_t *buffer;
+	void (*complete)(void *closure, bool success);
+	void *closure;
+	struct BlockRequest *next;
+};
+
+/**
+ * BlockStatistic, counters for request queue activity
+ *
+ * @param submitted  Requests accepted by block_submit()
+ * @param dispatched Disk commands issued
+ * @param merged     Requests that joined a command of another request
+ */
+struct BlockStatistic {
+	uint32_t submitted;
+	uint32_t dispatched;
+	uint32_t merged;
+};
+extern struct BlockStatistic block_statistic;
+
+/**
+ * Queue transfer without waiting. Pending requests are dispatched in C-LOOK
+ * order, requests with adjacent LBA and same direction are merged into one command.
+ * Caller must not submit overlapping requests while one of them is a write
+ *
+ * @param write                 Transfer direction, memory to disk
+ * @param buffer                Kernel memory with size of block_count * BLOCK_SIZE
+ * @param logical_block_address First block of transfer
+ * @param block_count           Block count of transfer
+ * @param complete              Completion callback
+ * @param closure               Passed to complete
+ * @return False if request pool is full, nothing is queued
+ */
+bool block_submit(
+		bool write, void *buffer, uint32_t logical_block_address, uint32_t block_count,
+		void (*complete)(void *closure, bool success), void *closure
+);
+
+/**
+ * Hold dispatch while a batch of related requests is submitted, so the first one
+ * is not sent alone before its neighbours arrive. Calls may nest
+ */
+void block_plug(void);
+
+// End batch started by block_plug(), dispatch if it was the outermost
+void block_unplug(void);
+
+/**
+ * Poll disk until every queued request is completed
+ */
+void block_wait(void);
+
+// True when nothing is queued or in flight
+bool is_block_queue_idle(void);
+
+#endif
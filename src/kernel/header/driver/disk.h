@@ -12,16 +12,116 @@
 #define ATA_STATUS_DF 0x20
 #define ATA_STATUS_ERR 0x01
 
+// Device control register, nIEN mask INTRQ while polling
+#define ATA_DEVICE_CONTROL 0x3F6
+#define ATA_CONTROL_NIEN 0x02
+
 #define HALF_BLOCK_SIZE (BLOCK_SIZE / 2)
 
+/* -- ATA commands -- */
+#define ATA_COMMAND_READ_SECTORS 0x20
+#define ATA_COMMAND_READ_SECTORS_EXT 0x24
+#define ATA_COMMAND_WRITE_SECTORS 0x30
+#define ATA_COMMAND_WRITE_SECTORS_EXT 0x34
+#define ATA_COMMAND_READ_MULTIPLE 0xC4
+#define ATA_COMMAND_READ_MULTIPLE_EXT 0x29
+#define ATA_COMMAND_WRITE_MULTIPLE 0xC5
+#define ATA_COMMAND_WRITE_MULTIPLE_EXT 0x39
+#define ATA_COMMAND_SET_MULTIPLE 0xC6
+#define ATA_COMMAND_IDENTIFY 0xEC
+
+/* -- IDENTIFY DEVICE word index -- */
+#define ATA_IDENTIFY_MAX_MULTIPLE 47
+#define ATA_IDENTIFY_LBA28_COUNT 60
+#define ATA_IDENTIFY_COMMAND_SET 83
+#define ATA_IDENTIFY_LBA48_COUNT 100
+#define ATA_IDENTIFY_LBA48 (1 << 10)
+
+// Block count limit of one command, sector count register value 0 encode the maximum
+#define ATA_LBA28_MAX_BLOCK 256
+#define ATA_LBA48_MAX_BLOCK 65536
+// Blocks per DRQ handshake asked with SET MULTIPLE MODE
+#define ATA_MAX_MULTIPLE 16
+
+/* -- Bus master IDE, primary channel registers from BAR4 -- */
+#define BM_COMMAND 0x0
+#define BM_STATUS 0x2
+#define BM_PRDT 0x4
+
+#define BM_COMMAND_START 0x01
+#define BM_COMMAND_READ 0x08 // Direction device to memory
+#define BM_STATUS_ACTIVE 0x01
+#define BM_STATUS_ERROR 0x02
+#define BM_STATUS_INTERRUPT 0x04
+
+#define ATA_COMMAND_READ_DMA 0xC8
+#define ATA_COMMAND_READ_DMA_EXT 0x25
+#define ATA_COMMAND_WRITE_DMA 0xCA
+#define ATA_COMMAND_WRITE_DMA_EXT 0x35
+
+// PRD entry can not cross 64 KiB, bounce buffer hold ATA_LBA28_MAX_BLOCK
+#define DMA_REGION_SIZE 0x10000
+#define DMA_REGION_COUNT 2
+#define DMA_BUFFER_SIZE (DMA_REGION_SIZE * DMA_REGION_COUNT)
+// Physically contiguous kernel buffers are used directly, one entry per 64 KiB piece
+#define DMA_PRD_COUNT 128
+#define PRD_END_OF_TABLE 0x8000
+
+// Sequential read size of disk_benchmark_sequential_read(), run on boot of DISK_BENCHMARK build
+#define DISK_BENCHMARK_BLOCK_COUNT 16384
+
+/**
+ * PhysicalRegionDescriptor, one physically contiguous region of DMA transfer
+ *
+ * @param address    Physical address of region
+ * @param byte_count Region size, 0 means 64 KiB
+ * @param flag       PRD_END_OF_TABLE on last entry
+ */
+struct PhysicalRegionDescriptor {
+	uint32_t address;
+	uint16_t byte_count;
+	uint16_t flag;
+} __attribute__((packed));
+
+/**
+ * ATADevice, primary master parameters probed with IDENTIFY DEVICE
+ *
+ * @param lba48          Device support 48-bit LBA commands
+ * @param block_count    Addressable block count, 0 if there is no disk
+ * @param multiple_count Blocks per DRQ handshake, 0 if READ/WRITE MULTIPLE is not used
+ */
+struct ATADevice {
+	bool lba48;
+	uint32_t block_count;
+	uint32_t multiple_count;
+};
+
+/**
+ * DiskStatistic, command counters per transfer method
+ *
+ * @param dma_direct DMA command with PRD pointing at caller buffer
+ * @param dma_bounce DMA command copied through bounce buffer
+ * @param pio        PIO command
+ * @param dma_kib_per_second Boot benchmark DMA throughput, 0 if not run
+ * @param pio_kib_per_second Boot benchmark PIO throughput, 0 if not run
+ */
+struct DiskStatistic {
+	uint32_t dma_direct;
+	uint32_t dma_bounce;
+	uint32_t pio;
+	uint32_t dma_kib_per_second;
+	uint32_t pio_kib_per_second;
+};
+extern struct DiskStatistic disk_statistic;
+
 // Block buffer data type - @param buf Byte buffer with size of BLOCK_SIZE
 struct BlockBuffer {
 	uint8_t buf[BLOCK_SIZE];
 } __attribute__((packed));
 
 /**
- * ATA PIO logical block address read blocks. Will blocking until read is completed.
- * Note: ATA PIO will use 2-bytes per read/write operation.
+ * ATA logical block address read blocks. Will blocking until read is completed.
+ * Large block_count is split into as few commands as possible.
  * Recommended to use struct BlockBuffer
  *
  * @param ptr                   Pointer for storing reading data, this pointer should point to already allocated memory location.
@@ -29,17 +129,127 @@ struct BlockBuffer {
  * @param logical_block_address Block address to read data from. Use LBA addressing
  * @param block_count           How many block to read, starting from block logical_block_address to lba-1
  */
-void read_blocks(void *ptr, uint32_t logical_block_address, uint8_t block_count);
+void read_blocks(void *ptr, uint32_t logical_block_address, uint32_t block_count);
 
 /**
- * ATA PIO logical block address write blocks. Will blocking until write is completed.
- * Note: ATA PIO will use 2-bytes per read/write operation.
+ * ATA logical block address write blocks. Will blocking until write is completed.
+ * Large block_count is split into as few commands as possible.
  * Recommended to use struct BlockBuffer
  *
  * @param ptr                   Pointer to data that to be written into disk. Memory pointed should be positive integer multiple of BLOCK_SIZE
  * @param logical_block_address Block address to write data into. Use LBA addressing
  * @param block_count           How many block to write, starting from block logical_block_address to lba-1
  */
-void write_blocks(const void *ptr, uint32_t logical_block_address, uint8_t block_count);
+void write_blocks(const void *ptr, uint32_t logical_block_address, uint32_t block_count);
+
+/**
+ * ATAAsyncRequest, transfer in flight driven by IRQ14. Bus master transfer complete on
+ * one interrupt, PIO transfer move one DRQ handshake per interrupt
+ *
+ * @param active                Request is in flight
+ * @param dma                   Transfer run by bus master over PRD table built from block_buffer
+ * @param write                 Transfer direction, memory to disk
+ * @param logical_block_address First block, kept to repeat failed bus master transfer with PIO
+ * @param block_count           Block count requested
+ * @param block_done            Block count already stored
+ * @param block_buffer          Return memory of block index of the request, must be kernel memory
+ * @param complete              Called once every block is stored or the disk report error
+ * @param closure               Passed to block_buffer and complete
+ */
+struct ATAAsyncRequest {
+	bool active;
+	bool dma;
+	bool write;
+	uint32_t logical_block_address;
+	uint32_t block_count;
+	uint32_t block_done;
+	void *(*block_buffer)(void *closure, uint32_t index);
+	void (*complete)(void *closure, bool success);
+	void *closure;
+};
+
+/**
+ * Start reading blocks without waiting. Bus master store blocks when every block buffer is
+ * physically contiguous kernel memory, otherwise blocks are stored from disk_isr() with PIO
+ *
+ * @param logical_block_address Block address to read data from
+ * @param block_count           How many block to read, at most one command worth
+ * @param block_buffer          Destination of each block
+ * @param complete              Completion callback, called inside interrupt handler
+ * @param closure               Passed to callbacks
+ * @return False if another asynchronous transfer is still in flight
+ */
+bool read_blocks_async(
+		uint32_t logical_block_address, uint32_t block_count,
+		void *(*block_buffer)(void *closure, uint32_t index),
+		void (*complete)(void *closure, bool success), void *closure
+);
+
+/**
+ * Start writing blocks without waiting, with bus master under same condition as
+ * read_blocks_async(). On PIO first DRQ handshake is served right away, the rest from disk_isr()
+ *
+ * @param logical_block_address Block address to write data into
+ * @param block_count           How many block to write, at most one command worth
+ * @param block_buffer          Source of each block
+ * @param complete              Completion callback, called inside interrupt handler
+ * @param closure               Passed to callbacks
+ * @return False if another asynchronous transfer is still in flight
+ */
+bool write_blocks_async(
+		uint32_t logical_block_address, uint32_t block_count,
+		void *(*block_buffer)(void *closure, uint32_t index),
+		void (*complete)(void *closure, bool success), void *closure
+);
+
+// Longest block_count accepted by read_blocks_async() and write_blocks_async()
+uint32_t get_async_max_block(void);
+
+/**
+ * Poll in flight asynchronous transfer until it is completed. read_blocks() and
+ * write_blocks() call this before using the disk. Completion callback may start
+ * another transfer, which is polled too
+ */
+void wait_async_blocks(void);
+
+// True when no asynchronous transfer is in flight
+bool is_disk_idle(void);
+
+// Unmask IRQ14 (and cascade) on PIC
+void activate_disk_interrupt(void);
+
+/**
+ * Look for PCI IDE controller and enable bus master DMA for read_blocks() and
+ * write_blocks(). Disk stays on PIO if there is none
+ *
+ * @return True if DMA is used
+ */
+bool initialize_disk_dma(void);
+
+// IRQ14 handler, move one DRQ handshake of in flight asynchronous transfer
+void disk_isr(void);
+
+/**
+ * Probe primary master with IDENTIFY DEVICE, enable 48-bit LBA when supported
+ * and SET MULTIPLE MODE. Must be called before any other disk operation
+ */
+void initialize_disk(void);
+
+/**
+ * Disk size probed by initialize_disk()
+ *
+ * @return Addressable block count, 0 if disk does not answer
+ */
+uint32_t get_disk_block_count(void);
+
+/**
+ * Time sequential read from start of disk with read_blocks(). Transfer is polled and
+ * switch DMA for the whole driver, only run on boot before any process exist
+ *
+ * @param block_count Block count to read, clamped to disk size
+ * @param dma         Use bus master, false measure PIO
+ * @return            Throughput in KiB per second, 0 if it could not run
+ */
+uint32_t disk_benchmark_sequential_read(uint32_t block_count, bool dma);
 
 #endif
@@ -0,0 +1,72 @@
+#ifndef _PCI_H
+#define _PCI_H
+
+#include <std/stdbool.h>
+#include <std/stdint.h>
+
+/* -- PCI configuration mechanism #1 -- */
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+#define PCI_BUS_COUNT 256
+#define PCI_SLOT_COUNT 32
+#define PCI_FUNCTION_COUNT 8
+
+/* -- Configuration space offsets -- */
+#define PCI_VENDOR_ID 0x00
+#define PCI_COMMAND 0x04
+#define PCI_CLASS 0x08
+#define PCI_HEADER_TYPE 0x0C
+#define PCI_BAR4 0x20
+
+#define PCI_VENDOR_NONE 0xFFFF
+#define PCI_HEADER_MULTIFUNCTION 0x80
+#define PCI_COMMAND_IO 0x0001
+#define PCI_COMMAND_BUS_MASTER 0x0004
+#define PCI_BAR_IO 0x1
+
+/* -- Class codes -- */
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+
+/**
+ * PCIDevice, location of one function on PCI bus
+ *
+ * @param bus      Bus number
+ * @param slot     Device number on bus
+ * @param function Function number on device
+ */
+struct PCIDevice {
+	uint8_t bus;
+	uint8_t slot;
+	uint8_t function;
+};
+
+/**
+ * Read dword from configuration space
+ *
+ * @param device Target function
+ * @param offset Register offset, 4-byte aligned
+ * @return Register value
+ */
+uint32_t pci_config_read(struct PCIDevice device, uint8_t offset);
+
+/**
+ * Write dword into configuration space
+ *
+ * @param device Target function
+ * @param offset Register offset, 4-byte aligned
+ * @param value  Register value
+ */
+void pci_config_write(struct PCIDevice device, uint8_t offset, uint32_t value);
+
+/**
+ * Scan every bus for the first function with class and subclass
+ *
+ * @param class_code Base class code
+ * @param subclass   Subclass code
+ * @param result     Location of found function
+ * @return True if found
+ */
+bool pci_find_device(uint8_t class_code, uint8_t subclass, struct PCIDevice *result);
+
+#endif
@@ -12,4 +12,14 @@ void handle_rtc_interrupt();
 void time_handle_timer_interrupt();
 void setup_time();
 
+// Read CPU timestamp counter, for timing shorter than timer tick or while interrupt is off
+uint64_t read_timestamp_counter(void);
+
+/**
+ * Timestamp counter rate, measured once against PIT channel 2
+ *
+ * @return Timestamp counter ticks per millisecond
+ */
+uint32_t get_timestamp_counter_khz(void);
+
 #endif
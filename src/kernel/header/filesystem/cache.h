@@ -0,0 +1,156 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <fat32.h>
+#include <std/stdbool.h>
+#include <std/stdint.h>
+
+/* -- Cluster cache constants -- */
+#define CACHE_ENTRY_COUNT 64
+#define CACHE_BUCKET_COUNT 64
+#define CACHE_EMPTY_CLUSTER 0xFFFFFFFF
+
+// Longest run handed to read_blocks() / write_blocks() at once, 1 MiB
+#define CACHE_MAX_RUN_CLUSTER 512
+
+// Asynchronous read transfer one DRQ handshake per interrupt, keep each prefetch short
+#define CACHE_ASYNC_MAX_CLUSTER 16
+// Entries that may wait on block request queue at once, rest stay evictable
+#define CACHE_MAX_LOADING (CACHE_ENTRY_COUNT / 2)
+
+/**
+ * CacheEntry, one cached cluster
+ *
+ * @param cluster    Cluster number cached by this entry, CACHE_EMPTY_CLUSTER if unused
+ * @param dirty      Entry content is newer than disk and must be written back
+ * @param loading    Entry is filled by in flight asynchronous read, buf is not valid yet
+ * @param writing    Entry is written by in flight asynchronous write back, buf must stay in place
+ * @param write_failed Last asynchronous write back failed, left for synchronous write back
+ * @param lru_prev   More recently used neighbour
+ * @param lru_next   Less recently used neighbour
+ * @param hash_next  Next entry in the same hash bucket
+ * @param buf        Cluster data
+ */
+struct CacheEntry {
+	uint32_t cluster;
+	bool dirty;
+	bool loading;
+	bool writing;
+	bool write_failed;
+	struct CacheEntry *lru_prev;
+	struct CacheEntry *lru_next;
+	struct CacheEntry *hash_next;
+	uint8_t buf[CLUSTER_SIZE];
+};
+
+/**
+ * CacheStatistic, counters for cluster cache activity
+ *
+ * @param hit       Cluster requests served from memory
+ * @param miss      Cluster requests that needed a disk read
+ * @param eviction  Entries reused for another cluster
+ * @param writeback Dirty clusters written to disk
+ */
+struct CacheStatistic {
+	uint32_t hit;
+	uint32_t miss;
+	uint32_t eviction;
+	uint32_t writeback;
+};
+extern struct CacheStatistic cache_statistic;
+
+/**
+ * Read one cluster through the cache. Missing cluster will be read from disk
+ * and kept as least recently evicted entry
+ *
+ * @param ptr     Pointer to buffer with size of CLUSTER_SIZE
+ * @param cluster Cluster number to read
+ */
+void cache_read_cluster(void *ptr, uint32_t cluster);
+
+/**
+ * Read consecutive clusters for streaming use. Cached clusters are copied from
+ * memory, every uncached run is fetched with as few read_blocks() calls as
+ * possible and is not inserted into the cache
+ *
+ * @param ptr     Pointer to buffer with size of count * CLUSTER_SIZE
+ * @param cluster First cluster number to read
+ * @param count   Cluster count to read
+ */
+void cache_read_clusters_direct(void *ptr, uint32_t cluster, uint32_t count);
+
+/**
+ * Write one cluster into the cache. Disk is only updated when the entry get
+ * evicted or cache_sync() is called
+ *
+ * @param ptr     Pointer to data with size of CLUSTER_SIZE
+ * @param cluster Cluster number to write
+ */
+void cache_write_cluster(const void *ptr, uint32_t cluster);
+
+/**
+ * Write consecutive clusters straight to disk, with as few write_blocks()
+ * calls as possible. Cached copies are refreshed and considered clean
+ *
+ * @param ptr     Pointer to data with size of count * CLUSTER_SIZE
+ * @param cluster First cluster number to write
+ * @param count   Cluster count to write
+ */
+void cache_write_clusters_direct(const void *ptr, uint32_t cluster, uint32_t count);
+
+/**
+ * Write every dirty entry back to disk, entries stay cached
+ */
+void cache_sync(void);
+
+/**
+ * Queue every dirty entry on block request queue without waiting. Entry modified
+ * while it is written stay dirty for the next write back
+ */
+void cache_write_back_async(void);
+
+/**
+ * Halt predicate for scheduler_halt_current_process()
+ *
+ * @param closure Unused
+ * @return True once no entry is written by cache_write_back_async()
+ */
+bool cache_is_written(void *closure);
+
+/**
+ * Check whether a cluster can be brought into the cache without writing another
+ * one back first, also used as halt predicate
+ *
+ * @param closure Unused
+ * @return True if an idle clean entry exist
+ */
+bool cache_has_clean_entry(void *closure);
+
+/**
+ * Check whether cluster can be read from memory without touching the disk
+ *
+ * @param cluster Cluster number to check
+ * @return True if cluster is cached and not loading
+ */
+bool cache_is_ready(uint32_t cluster);
+
+/**
+ * Queue reads of consecutive clusters into the cache on block request queue.
+ * Clusters already cached are skipped, at most CACHE_ASYNC_MAX_CLUSTER are looked at.
+ * Synchronous cache call on a loading entry wait for it first
+ *
+ * @param cluster First cluster number to load
+ * @param count   Cluster count wanted
+ * @return False if first cluster could not be queued, read it synchronously instead
+ */
+bool cache_prefetch_async(uint32_t cluster, uint32_t count);
+
+/**
+ * Halt predicate for scheduler_halt_current_process()
+ *
+ * @param closure Pointer to cluster number
+ * @return True once cluster is no longer loading
+ */
+bool cache_is_loaded(void *closure);
+
+#endif
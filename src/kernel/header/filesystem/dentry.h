@@ -0,0 +1,82 @@
+#ifndef _DENTRY_H
+#define _DENTRY_H
+
+#include <std/stdbool.h>
+#include <std/stdint.h>
+
+/* -- Dentry cache constants -- */
+#define DENTRY_CACHE_SIZE 256
+
+// 8.3 fullname with dot and null terminator
+#define DENTRY_NAME_SIZE (8 + 1 + 3 + 1)
+
+/**
+ * DentryCacheEntry, result of looking up one name inside one directory
+ *
+ * @param used            Slot is holding an entry
+ * @param negative        Name is known to be missing from the directory
+ * @param parent_cluster  Cluster of directory containing the name
+ * @param name            8.3 fullname, as produced for path lookup
+ * @param table_cluster   Cluster of parent directory table holding the entry
+ * @param directory_index Index of entry inside table_cluster
+ * @param cluster         First cluster of the entry
+ * @param attribute       Attribute of the entry
+ */
+struct DentryCacheEntry {
+	bool used;
+	bool negative;
+	uint32_t parent_cluster;
+	char name[DENTRY_NAME_SIZE];
+	uint32_t table_cluster;
+	uint32_t directory_index;
+	uint32_t cluster;
+	uint8_t attribute;
+};
+
+/**
+ * Find cached lookup result for name inside parent directory
+ *
+ * @param parent_cluster Cluster of directory to search
+ * @param name           Name to search
+ * @param result         Copy of cached entry, check result->negative
+ * @return True when lookup is cached
+ */
+bool dentry_lookup(uint32_t parent_cluster, char *name, struct DentryCacheEntry *result);
+
+/**
+ * Remember name inside parent directory, replacing any older result
+ *
+ * @param parent_cluster  Cluster of directory containing the name
+ * @param name            Name of entry
+ * @param table_cluster   Cluster of parent directory table holding the entry
+ * @param directory_index Index of entry inside table_cluster
+ * @param cluster         First cluster of the entry
+ * @param attribute       Attribute of the entry
+ */
+void dentry_insert(uint32_t parent_cluster, char *name, uint32_t table_cluster, uint32_t directory_index, uint32_t cluster, uint8_t attribute);
+
+/**
+ * Remember that name does not exist inside parent directory
+ *
+ * @param parent_cluster Cluster of searched directory
+ * @param name           Missing name
+ */
+void dentry_insert_negative(uint32_t parent_cluster, char *name);
+
+/**
+ * Forget cached result of name inside parent directory
+ *
+ * @param parent_cluster Cluster of directory containing the name
+ * @param name           Name to forget
+ */
+void dentry_invalidate(uint32_t parent_cluster, char *name);
+
+/**
+ * Forget every cached name inside directory, used when its cluster is freed
+ * or its entries are moved
+ *
+ * @param parent_cluster Cluster of directory
+ */
+void dentry_invalidate_directory(uint32_t parent_cluster);
+
+#endif
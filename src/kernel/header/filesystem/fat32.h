@@ -13,8 +13,14 @@
 
 /* -- IF2230 File System constants -- */
 #define BOOT_SECTOR 0
+
+// FAT entry count held by one FAT cluster (FAT page)
 #define CLUSTER_MAP_SIZE 512
 
+// FAT pages are chained from FAT entry of cluster 1, 256 pages => 256 MiB volume
+#define FAT_MAX_PAGE_COUNT 256
+#define FAT_SECTOR_CACHE_SIZE 32
+
 /* -- FAT32 FileAllocationTable constants -- */
 // FAT reserved value for cluster 0 and 1 in FileAllocationTable
 #define CLUSTER_0_VALUE 0x0FFFFFF0
@@ -23,8 +29,24 @@
 // EOF also double as valid cluster / "this is last valid cluster in the chain"
 #define FAT32_FAT_EMPTY_ENTRY 0x00000000
 #define FAT32_FAT_END_OF_FILE 0x0FFFFFFF
+#define FAT32_FAT_BAD_CLUSTER 0x0FFFFFF7
 
 #define FAT_CLUSTER_NUMBER 1
+#define FAT_SECTOR_ENTRY_COUNT (BLOCK_SIZE / sizeof(uint32_t))
+
+// Opened file filesize and FAT changes are flushed at most this late by fat32_flush_expired()
+#define FAT32_MAX_DIRTY_SECOND 5
+
+// Extent kept per opened file for random access
+#define FAT32_EXTENT_COUNT 32
+
+// Readahead window in clusters, doubled on every sequential read
+#define FAT32_READAHEAD_MIN 2
+#define FAT32_READAHEAD_MAX 16
+
+// Directories with bucket cluster map kept in memory, and bucket limit of one directory
+#define FAT32_BUCKET_MAP_COUNT 8
+#define FAT32_BUCKET_MAX 128
 
 /* -- FAT32 DirectoryEntry constants -- */
 #define RESERVED_ENTRY 2
@@ -40,7 +62,8 @@ struct ClusterBuffer {
 /* -- FAT32 Data Structures -- */
 
 /**
- * FAT32 FileAllocationTable, for more information about this, check guidebook
+ * FAT32 FileAllocationTable page, for more information about this, check guidebook.
+ * Page i hold FAT entries of cluster i * CLUSTER_MAP_SIZE onward
  *
  * @param cluster_map Containing cluster map of FAT32
  */
@@ -51,16 +74,20 @@ struct FAT32FileAllocationTable {
 /* -- FAT32 Driver -- */
 
 /**
- * FAT32DriverState - Contain all driver states
+ * FAT32DriverState - Contain all driver states. FAT entries are not kept here,
+ * FAT sectors are loaded on demand into a small sector cache
  *
- * @param fat_table     FAT of the system, will be loaded during
- * initialize_filesystem_fat32()
- * @param cluster_buf   Buffer for cluster, can be used for temp var
+ * @param cluster_count    Usable cluster count, bounded by disk size and FAT pages
+ * @param fat_page_count   FAT cluster count
+ * @param fat_page_cluster Cluster number of each FAT page, first one is FAT_CLUSTER_NUMBER
+ * @param cluster_buf      Buffer for cluster, can be used for temp var
  */
 struct FAT32DriverState {
-	struct FAT32FileAllocationTable fat_table;
+	uint32_t cluster_count;
+	uint32_t fat_page_count;
+	uint32_t fat_page_cluster[FAT_MAX_PAGE_COUNT];
 	struct ClusterBuffer cluster_buf;
-} __attribute__((packed));
+};
 extern struct FAT32DriverState fat32_driver_state;
 
 /* -- Driver Interfaces -- */
@@ -82,40 +109,48 @@ bool is_empty_storage(void);
 
 /**
  * Create new FAT32 file system. Will write fs_signature into boot sector and
- * proper FileAllocationTable (contain CLUSTER_0_VALUE, CLUSTER_1_VALUE,
- * and initialized root directory) into cluster number 1
+ * first FileAllocationTable page (contain CLUSTER_0_VALUE, end of FAT page
+ * chain, and initialized root directory) into cluster number 1
  */
 void create_fat32(void);
 
 /**
  * Initialize file system driver state, if is_empty_storage() then
- * create_fat32() Else, read and cache entire FileAllocationTable (located at
- * cluster number 1) into driver state
+ * create_fat32(). FAT page chain is followed from cluster number 1 and extended
+ * until it covers the whole disk, each new page stored in the first cluster it
+ * covers. FAT is kept outside cluster cache, loaded
+ * and written back per sector
  */
 void initialize_filesystem_fat32(void);
 
 /**
- * Write cluster operation, wrapper for write_blocks().
+ * Write FAT and filesize of every opened file once the oldest unwritten change is
+ * FAT32_MAX_DIRTY_SECOND old. Called on syscall entry and scheduler idle, where no file
+ * system operation is in progress
+ */
+void fat32_flush_expired(void);
+
+/**
+ * Write cluster operation, goes through the cluster cache (filesystem/cache.h).
+ * Disk is updated on eviction or cache_sync().
  * Recommended to use struct ClusterBuffer
  *
  * @param ptr            Pointer to source data
  * @param cluster_number Cluster number to write
- * @param cluster_count  Cluster count to write, due limitation of write_blocks
- * block_count 255 => max cluster_count = 63
+ * @param cluster_count  Cluster count to write
  */
 void write_clusters(
-		const void *ptr, uint32_t cluster_number, uint8_t cluster_count
+		const void *ptr, uint32_t cluster_number, uint32_t cluster_count
 );
 
 /**
- * Read cluster operation, wrapper for read_blocks().
+ * Read cluster operation, goes through the cluster cache (filesystem/cache.h).
  * Recommended to use struct ClusterBuffer
  *
  * @param ptr            Pointer to buffer for reading
  * @param cluster_number Cluster number to read
- * @param cluster_count  Cluster count to read, due limitation of read_blocks
- * block_count 255 => max cluster_count = 63
+ * @param cluster_count  Cluster count to read
  */
-void read_clusters(void *ptr, uint32_t cluster_number, uint8_t cluster_count);
+void read_clusters(void *ptr, uint32_t cluster_number, uint32_t cluster_count);
 
 #endif
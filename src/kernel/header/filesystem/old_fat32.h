@@ -3,6 +3,16 @@
 
 #include <filesystem/fat32.h>
 
+/**
+ * OldFAT32DriverState - Old API keep the whole first FAT page in memory
+ *
+ * @param fat_table FAT of the system, loaded during initialize_filesystem_fat32()
+ */
+struct OldFAT32DriverState {
+	struct FAT32FileAllocationTable fat_table;
+} __attribute__((packed));
+extern struct OldFAT32DriverState old_fat32_driver_state;
+
 /* -- CRUD Operation -- */
 
 /**
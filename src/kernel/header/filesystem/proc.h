@@ -2,6 +2,10 @@
 #define _PROC_H
 
 #include "filesystem/vfs.h"
+
+// Largest generated file, fits one read of shell cat
+#define PROC_CONTENT_SIZE 512
+
 extern struct VFSHandler proc_vfs;
 
 #endif
@@ -1,6 +1,7 @@
 #ifndef _VFS_H
 #define _VFS_H
 
+#include <std/stdbool.h>
 #include <vfs.h>
 
 /*
@@ -13,10 +14,15 @@ struct VFSHandler {
 
 	int (*open)(char *path);
 	int (*close)(int ft);
+	int (*fsync)(int ft);
 
 	int (*read)(int ft, char *buffer, int size);
 	int (*write)(int ft, char *buffer, int size);
 
+	int (*seek)(int ft, int offset, int whence);
+	int (*pread)(int ft, char *buffer, int size, int offset);
+	int (*pwrite)(int ft, char *buffer, int size, int offset);
+
 	int (*mkfile)(char *path);
 	int (*mkdir)(char *path);
 
@@ -34,4 +40,17 @@ int unregister_file_table_context(int ft);
 
 extern struct VFSHandler vfs;
 
+/*
+ * Set by syscall handler around VFS_READ, VFS_WRITE, VFS_PWRITE, VFS_CLOSE, VFS_FSYNC,
+ * VFS_MKDIR, VFS_MKFILE and VFS_DELETE. Handler may then park current process with
+ * scheduler_halt_current_process(..., recall = true) instead of waiting on disk, the
+ * syscall is restarted from the beginning once it is woken up. Directory changes
+ * are queued and not waited for.
+ *
+ * Disk is still polled where no process can be parked: page fault program frame
+ * fill, kernel setup, files closed by process_destroy(), and FAT sector, dentry or
+ * directory cluster missing from memory during path lookup and dirstat
+ */
+extern bool vfs_may_block;
+
 #endif
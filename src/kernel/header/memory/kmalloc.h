@@ -3,10 +3,50 @@
 
 #include <std/stdint.h>
 
+// Small object size classes, class i serve object of SLAB_MIN_OBJECT << i bytes
+#define SLAB_CLASS_COUNT 7
+#define SLAB_MIN_OBJECT 16
+
+/**
+ * KmallocStatistic, snapshot of kernel heap usage
+ *
+ * @param heap_size    Bytes of mapped heap, grown frames included
+ * @param used         Bytes in allocated large blocks, slab pages included
+ * @param free         Bytes in free large blocks
+ * @param largest_free Size of largest free block, bound for next large allocation without growth
+ * @param used_block   Allocated large block count
+ * @param free_block   Free large block count, high count with low largest_free means fragmentation
+ * @param allocation   Successful kmalloc call count since boot
+ * @param release      kfree call count since boot
+ * @param failure      kmalloc call that returned NULL since boot
+ * @param slab_page    Slab page count per size class
+ * @param slab_object  Allocated object count per size class
+ */
+struct KmallocStatistic {
+	uint32_t heap_size;
+	uint32_t used;
+	uint32_t free;
+	uint32_t largest_free;
+	uint32_t used_block;
+	uint32_t free_block;
+	uint32_t allocation;
+	uint32_t release;
+	uint32_t failure;
+	uint32_t slab_page[SLAB_CLASS_COUNT];
+	uint32_t slab_object[SLAB_CLASS_COUNT];
+};
+
 void *kmalloc(uint32_t size);
 void *kmalloc_aligned(uint32_t size, uint32_t align);
 void kfree(void *address);
 
+/**
+ * Fill statistic with current heap usage, walk every large block
+ *
+ * @param statistic Destination snapshot
+ */
+void kmalloc_get_statistic(struct KmallocStatistic *statistic);
+
 // void ktest();
 
 #endif
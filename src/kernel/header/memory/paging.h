@@ -7,10 +7,8 @@
 #define PAGE_ENTRY_COUNT 1024
 // PF Size: (1 << 22) B = 4*1024*1024 B = 4 MiB. PF memory total: 4*32 = 128 MB
 #define PAGE_FRAME_SIZE (1 << (2 + 10 + 10))
+// Frame bitmap is one uint32_t, keep at most 32
 #define PAGE_FRAME_MAX_COUNT 32
-// Used for memory manager, invalid physical page frame value for higher half
-// kernel
-#define PAGE_FRAME_UNMAPPED 0xFF
 
 // Operating system page directory, using page size PAGE_FRAME_SIZE (4 MiB)
 extern struct PageDirectory _paging_kernel_page_directory;
@@ -72,13 +70,11 @@ struct PageDirectory {
 /**
  * Containing page manager states.
  *
- * @param page_frame_map Keeping track empty space
- * ...
+ * @param free_frame_map        Bit i is set while physical frame i is free
+ * @param free_page_frame_count Number of set bit in free_frame_map
  */
 struct PageManagerState {
-	bool mapped[PAGE_FRAME_MAX_COUNT];
-	void *mapped_address[PAGE_FRAME_MAX_COUNT];
-	struct PageDirectory *mapped_dir[PAGE_FRAME_MAX_COUNT];
+	uint32_t free_frame_map;
 	uint32_t free_page_frame_count;
 } __attribute__((packed));
 
@@ -103,14 +99,6 @@ void update_page_directory_entry(
 void flush_single_tlb(void *virtual_addr);
 
 /* --- Memory Management --- */
-/**
- * Check whether a certain amount of physical memory is available
- *
- * @param amount Requested amount of physical memory in bytes
- * @return       Return true when there's enough free memory available
- */
-bool paging_allocate_check(uint32_t amount);
-
 /**
  * Allocate single user page frame in page directory
  *
@@ -133,11 +121,51 @@ bool paging_free_user_page_frame(
 		struct PageDirectory *page_dir, void *virtual_addr
 );
 
+/* --- Kernel Memory Management --- */
+/**
+ * Map free physical frame into kernel half of kernel page directory and every
+ * process page directory, used to grow kernel heap
+ *
+ * @param virtual_addr Kernel virtual address to map, 4 MiB aligned
+ * @return             True if a frame was available
+ */
+bool paging_allocate_kernel_page_frame(void *virtual_addr);
+
+/**
+ * Unmap kernel frame from every page directory and release it
+ *
+ * @param virtual_addr Kernel virtual address mapped by paging_allocate_kernel_page_frame
+ * @return             True if frame was mapped
+ */
+bool paging_free_kernel_page_frame(void *virtual_addr);
+
+/**
+ * Translate kernel virtual address through kernel page directory
+ *
+ * @param virtual_addr Kernel half virtual address
+ * @return             Physical address
+ */
+void *paging_virtual_to_physical(void *virtual_addr);
+
+/* --- Page Fault --- */
+// Page fault error code bits
+#define PAGE_FAULT_ERROR_PRESENT 0x1
+#define PAGE_FAULT_ERROR_WRITE 0x2
+#define PAGE_FAULT_ERROR_USER 0x4
+
+/**
+ * Get faulting linear address of last page fault from CR2 register
+ *
+ * @return Address that caused the page fault
+ */
+void *paging_get_fault_address(void);
+
 /* --- Process-related Memory Management --- */
 #define PAGING_DIRECTORY_TABLE_MAX_COUNT 32
 
 /**
- * Create new page directory prefilled with 1 page directory entry for kernel higher half mapping
+ * Create new page directory prefilled with kernel higher half entries, registered so
+ * later kernel heap growth is mapped into it too
  *
  * @return Pointer to page directory virtual address. Return NULL if allocation failed
  */
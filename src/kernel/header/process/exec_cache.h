@@ -0,0 +1,76 @@
+#ifndef _EXEC_CACHE_H
+#define _EXEC_CACHE_H
+
+#include <std/stdbool.h>
+#include <std/stdint.h>
+#include <vfs.h>
+
+/* -- Executable image cache constants -- */
+#define EXEC_CACHE_ENTRY_COUNT 8
+#define EXEC_CACHE_PATH_SIZE 64
+// Total bytes of cached images, least recently executed are evicted beyond this
+#define EXEC_CACHE_BUDGET (128 * 1024)
+
+/**
+ * ExecCacheEntry, image of one recently executed program
+ *
+ * @param path      Path given to exec, empty if entry is unused
+ * @param size      File size when image was read
+ * @param location  Backing store location of file (first cluster for FAT32)
+ * @param last_used Exec counter value of last hit, for LRU eviction
+ * @param image     Copy of file content, size bytes
+ */
+struct ExecCacheEntry {
+	char path[EXEC_CACHE_PATH_SIZE];
+	uint32_t size;
+	uint32_t location;
+	uint32_t last_used;
+	void *image;
+};
+
+/**
+ * ExecCacheStatistic, counters for executable image cache
+ *
+ * @param hit          Exec served from memory
+ * @param miss         Exec that had to read file system
+ * @param eviction     Images dropped to fit budget or entry count
+ * @param invalidation Images dropped because file was written or deleted
+ * @param used         Bytes currently held by cached images
+ */
+struct ExecCacheStatistic {
+	uint32_t hit;
+	uint32_t miss;
+	uint32_t eviction;
+	uint32_t invalidation;
+	uint32_t used;
+};
+extern struct ExecCacheStatistic exec_cache_statistic;
+
+/**
+ * Copy cached image of path into destination when entry still describe same file
+ *
+ * @param path        Executable path
+ * @param entry       Fresh stat result of path
+ * @param destination Where image is copied, at least entry->size bytes
+ * @return            True on hit, false if file must be read
+ */
+bool exec_cache_load(char *path, struct VFSEntry *entry, void *destination);
+
+/**
+ * Keep copy of executable image just read from file system, evicting older
+ * images when budget is exceeded. Image that does not fit is not cached
+ *
+ * @param path  Executable path
+ * @param entry Stat result used for the read
+ * @param image File content, entry->size bytes
+ */
+void exec_cache_insert(char *path, struct VFSEntry *entry, void *image);
+
+/**
+ * Drop every image read from location, called when file content change
+ *
+ * @param location Backing store location of changed file
+ */
+void exec_cache_invalidate(uint32_t location);
+
+#endif
@@ -11,6 +11,11 @@
 
 #define PROCESS_NAME_LENGTH_MAX 32
 #define PROCESS_PAGE_FRAME_COUNT_MAX 8
+#define PROCESS_IMAGE_PATH_LENGTH_MAX 256
+
+// User stack grows down from kernel base, frames are mapped on first touch
+#define PROCESS_STACK_TOP KERNEL_VIRTUAL_ADDRESS_BASE
+#define PROCESS_STACK_FRAME_COUNT_MAX 2
 
 #define PROCESS_COUNT_MAX 32
 #define PROCESS_START_PID 1
@@ -57,6 +62,13 @@ enum ProcessState {
 	Waiting
 };
 
+// Outcome of process_handle_page_fault
+enum PageFaultStatus {
+	PageFaultMapped,
+	PageFaultOutOfMemory,
+	PageFaultInvalid
+};
+
 /**
  * Contain information needed for task to be able to get interrupted and resumed later
  *
@@ -86,6 +98,7 @@ struct ProcessNotifier {
  * @param metadata Process metadata, contain various information about process
  * @param context  Process context used for context saving & switching
  * @param memory   Memory used for the process
+ * @param image    Executable backing program frames, read on first touch
  */
 struct ProcessControlBlock {
 	struct ProcessMetadata {
@@ -98,6 +111,12 @@ struct ProcessControlBlock {
 	struct ProcessNotifier notifier;
 
 	int fd[PROCESS_MAX_FD]; // File descriptor table
+
+	struct ProcessImage {
+		char path[PROCESS_IMAGE_PATH_LENGTH_MAX];
+		uint32_t size;
+		uint32_t location; // Detect executable replaced after exec
+	} image;
 };
 
 /**
@@ -121,6 +140,36 @@ int process_destroy(int pid);
 
 struct ProcessControlBlock *get_pcb_from_pid(int pid);
 
+/**
+ * Map frame for page fault of current process, program frames are filled from
+ * its executable and stack frames are added as stack grows. Memory is not reserved
+ * at exec, so running out of frames is only found here
+ *
+ * @param address    Faulting address from CR2
+ * @param error_code Page fault error code pushed by CPU
+ * @return           PageFaultMapped if faulting instruction can be restarted, otherwise process must be killed
+ */
+enum PageFaultStatus process_handle_page_fault(void *address, uint32_t error_code);
+
+/**
+ * Map every missing frame of user buffer before kernel touch it, so no program frame
+ * has to be read from file system by fault raised inside disk driver
+ *
+ * @param buffer User buffer given to syscall
+ * @param size   Buffer size in bytes
+ * @return       False if buffer is outside process memory or can not be mapped
+ */
+bool process_fault_in_user_buffer(void *buffer, uint32_t size);
+
+/**
+ * Map every missing frame of null terminated user string, frame by frame while
+ * searching its terminator
+ *
+ * @param str User string given to syscall
+ * @return    False if string does not end inside process memory or can not be mapped
+ */
+bool process_fault_in_user_string(char *str);
+
 void process_current_sleep(uint32_t seconds);
 
 #endif
@@ -303,9 +303,12 @@ void cp() {
 
 	int block = 512;
 	char buffer[block];
-	while (syscall_VFS_READ(from_fd, buffer, block) > 0) {
-		syscall_VFS_WRITE(to_fd, buffer, block);
+	int read_count;
+	while ((read_count = syscall_VFS_READ(from_fd, buffer, block)) > 0) {
+		syscall_VFS_WRITE(to_fd, buffer, read_count);
 	}
+	syscall_VFS_CLOSE(from_fd);
+	syscall_VFS_CLOSE(to_fd);
 
 	puts("Copy succeed");
 }
@@ -388,9 +391,12 @@ void mv() {
 
 	int block = 512;
 	char buffer[block];
-	while (syscall_VFS_READ(from_fd, buffer, block) > 0) {
-		syscall_VFS_WRITE(to_fd, buffer, block);
+	int read_count;
+	while ((read_count = syscall_VFS_READ(from_fd, buffer, block)) > 0) {
+		syscall_VFS_WRITE(to_fd, buffer, read_count);
 	}
+	syscall_VFS_CLOSE(from_fd);
+	syscall_VFS_CLOSE(to_fd);
 
 	syscall_VFS_DELETE(fullpath_from);
 
@@ -4,17 +4,25 @@
 #include <std/string.h>
 #include <syscall.h>
 
+// Word-sized string instructions for the bulk, byte-sized for the tail
 void *memset(void *s, int c, size_t n) {
-	uint8_t *buf = (uint8_t *)s;
-	for (size_t i = 0; i < n; i++) buf[i] = (uint8_t)c;
+	void *dest = s;
+	size_t words = n / 4;
+	size_t tail = n % 4;
+	uint32_t fill = (uint8_t)c * 0x01010101u;
+	__asm__ volatile("cld; rep stosl" : "+D"(dest), "+c"(words) : "a"(fill) : "memory");
+	__asm__ volatile("rep stosb" : "+D"(dest), "+c"(tail) : "a"(fill) : "memory");
 	return s;
 }
 
 void *memcpy(void *restrict dest, const void *restrict src, size_t n) {
-	uint8_t *dstbuf = (uint8_t *)dest;
-	const uint8_t *srcbuf = (const uint8_t *)src;
-	for (size_t i = 0; i < n; i++) dstbuf[i] = srcbuf[i];
-	return dstbuf;
+	void *dstbuf = dest;
+	const void *srcbuf = src;
+	size_t words = n / 4;
+	size_t tail = n % 4;
+	__asm__ volatile("cld; rep movsl" : "+D"(dstbuf), "+S"(srcbuf), "+c"(words) : : "memory");
+	__asm__ volatile("rep movsb" : "+D"(dstbuf), "+S"(srcbuf), "+c"(tail) : : "memory");
+	return dest;
 }
 
 int memcmp(const void *s1, const void *s2, size_t n) {
@@ -84,7 +84,7 @@ struct FAT32DriverRequest {
 } __attribute__((packed));
 
 static inline uint32_t get_cluster_from_dir_entry(struct FAT32DirectoryEntry *dir_entry) {
-	return (dir_entry->cluster_low) + (((uint32_t)dir_entry->cluster_high) >> 16);
+	return (dir_entry->cluster_low) + (((uint32_t)dir_entry->cluster_high) << 16);
 }
 
 extern struct VFSHandler fat32_vfs;
@@ -4,9 +4,11 @@
 #define uint8_t unsigned char
 #define uint16_t unsigned short
 #define uint32_t unsigned int
+#define uint64_t unsigned long long
 
 #define int8_t signed char
 #define int16_t signed short
 #define int32_t signed int
+#define int64_t signed long long
 
 #endif
@@ -17,6 +17,13 @@ static inline int syscall(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx
 	return result;
 }
 
+// Fourth parameter is passed on esi
+static inline int syscall4(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx, uint32_t esi) {
+	int result;
+	__asm__ volatile("int $0x30" : "=a"(result) : "a"(eax), "b"(ebx), "c"(ecx), "d"(edx), "S"(esi) : "memory");
+	return result;
+}
+
 #define SYSCALL(syscall_number, ...)                        \
 	static inline int syscall_##syscall_number(__VA_ARGS__) { \
 		return syscall(__VA_ARGS__)                             \
@@ -42,6 +49,11 @@ static inline int syscall(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx
 		return syscall(syscall_number, (uint32_t)first_param, (uint32_t)second_param, (uint32_t)third_param);                \
 	}
 
+#define SYSCALL_4(syscall_number, first_type, first_param, second_type, second_param, third_type, third_param, fourth_type, fourth_param) \
+	static inline int syscall_##syscall_number(first_type first_param, second_type second_param, third_type third_param, fourth_type fourth_param) { \
+		return syscall4(syscall_number, (uint32_t)first_param, (uint32_t)second_param, (uint32_t)third_param, (uint32_t)fourth_param); \
+	}
+
 // Input
 #define GET_CHAR 4
 SYSCALL_1(GET_CHAR, char *, c);
@@ -113,4 +125,16 @@ SYSCALL_1(VFS_MKDIR, char *, path)
 #define VFS_DELETE 139
 SYSCALL_1(VFS_DELETE, char *, path)
 
+#define VFS_FSYNC 140
+SYSCALL_1(VFS_FSYNC, int, fd)
+
+#define VFS_SEEK 141
+SYSCALL_3(VFS_SEEK, int, fd, int, offset, int, whence)
+
+#define VFS_PREAD 142
+SYSCALL_4(VFS_PREAD, int, fd, char *, buffer, int, size, int, offset)
+
+#define VFS_PWRITE 143
+SYSCALL_4(VFS_PWRITE, int, fd, char *, buffer, int, size, int, offset)
+
 #endif
@@ -7,10 +7,16 @@ enum VFSType {
 	Directory
 };
 
+// Seek origin
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
 struct VFSEntry {
 	char name[MAX_VFS_NAME];
 	int size;
 	enum VFSType type;
+	unsigned int location; // Where content lives on backing store, first cluster for FAT32, 0 if none
 };
 
 #endif